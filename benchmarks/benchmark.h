@@ -0,0 +1,52 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+/*
+Helpers shared by the benchmark programs.
+measure() runs a function a few times and prints the fastest run, which filters out most of the noise.
+    Each run should start from the same state, so setup that must be repeated goes inside of the function.
+Results can be passed to keep() so the compiler can't optimize away the work that made them.
+*/
+
+// Runs a function a number of times, prints the fastest time, and returns it in milliseconds
+template <class Function>
+double measure(const std::string& name, unsigned runs, Function function)
+{
+    double best = 0;
+    for (unsigned i = 0; i < runs; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = (i == 0 ? elapsed.count() : std::min(best, elapsed.count()));
+    }
+    std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(2) << std::setw(10) << best << " ms\n";
+    return best;
+}
+
+// Prints how many times faster the second time is than the first
+inline void printSpeedup(double before, double after)
+{
+    std::cout << std::left << std::setw(48) << "    speedup" << std::right << std::fixed << std::setprecision(2) << std::setw(10) << (after > 0 ? before / after : 0) << " x\n";
+}
+
+// Stores a value somewhere the compiler has to assume is read
+template <class Type>
+void keep(const Type& value)
+{
+    static volatile Type sink;
+    sink = value;
+    // Reading it back keeps -Wall from warning that it is never used
+    (void)sink;
+}
+
+#endif
@@ -0,0 +1,92 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+// Compares the tile and pixel conversions of TileMap to the shifts of FixedTileMap
+
+#include <cmath>
+#include <SFML/Graphics.hpp>
+#include "nage/graphics/fixedtilemap.h"
+#include "benchmark.h"
+
+const unsigned mapSize = 1024;
+const unsigned tileSize = 16;
+const unsigned calls = 20000000;
+const unsigned runs = 5;
+const char* tilesetFile = "benchmark_tileset.png";
+
+int main()
+{
+    // Generate a 16x16 tile tileset, so the benchmark doesn't depend on any assets
+    sf::Image image;
+    image.create(tileSize * 16, tileSize * 16, sf::Color::White);
+    if (!image.saveToFile(tilesetFile))
+        return 1;
+
+    // Both cases use the same map, the TileMap reference just calls the functions that FixedTileMap hides
+    ng::FixedTileMap<tileSize> fixedMap;
+    if (!fixedMap.loadTileset(tilesetFile))
+        return 1;
+    fixedMap.resize(mapSize, mapSize);
+    ng::TileMap& tileMap = fixedMap;
+    const sf::Vector2u& size = tileMap.getTileSize();
+
+    std::cout << "Converting " << calls << " positions:\n";
+    double before = measure("TileMap::getCenterPoint()", runs, [&]
+    {
+        float sum = 0;
+        for (unsigned i = 0; i < calls; ++i)
+            sum += tileMap.getCenterPoint<float>(i % mapSize, i / mapSize % mapSize).x;
+        keep(sum);
+    });
+    double after = measure("FixedTileMap::getCenterPoint()", runs, [&]
+    {
+        float sum = 0;
+        for (unsigned i = 0; i < calls; ++i)
+            sum += fixedMap.getCenterPoint<float>(i % mapSize, i / mapSize % mapSize).x;
+        keep(sum);
+    });
+    printSpeedup(before, after);
+
+    before = measure("TileMap::getBoundingBox()", runs, [&]
+    {
+        float sum = 0;
+        for (unsigned i = 0; i < calls; ++i)
+            sum += tileMap.getBoundingBox(i % mapSize, i / mapSize % mapSize).top;
+        keep(sum);
+    });
+    after = measure("FixedTileMap::getBoundingBox()", runs, [&]
+    {
+        float sum = 0;
+        for (unsigned i = 0; i < calls; ++i)
+            sum += fixedMap.getBoundingBox(i % mapSize, i / mapSize % mapSize).top;
+        keep(sum);
+    });
+    printSpeedup(before, after);
+
+    // TileMap has no pixel to tile conversion, so the baseline divides by the tile size like game code would
+    // The positions start left of and above the map, so negative positions are included
+    before = measure("Dividing by getTileSize()", runs, [&]
+    {
+        int sum = 0;
+        for (unsigned i = 0; i < calls; ++i)
+        {
+            int x = static_cast<int>(i % 4096) - 2048;
+            int y = static_cast<int>(i / 4096 % 4096) - 2048;
+            sum ^= static_cast<int>(std::floor(static_cast<float>(x) / size.x)) + static_cast<int>(std::floor(static_cast<float>(y) / size.y));
+        }
+        keep(sum);
+    });
+    after = measure("FixedTileMap::getTilePosition()", runs, [&]
+    {
+        int sum = 0;
+        for (unsigned i = 0; i < calls; ++i)
+        {
+            sf::Vector2i tile = fixedMap.getTilePosition(sf::Vector2i(static_cast<int>(i % 4096) - 2048,
+                                                                       static_cast<int>(i / 4096 % 4096) - 2048));
+            sum ^= tile.x + tile.y;
+        }
+        keep(sum);
+    });
+    printSpeedup(before, after);
+    return 0;
+}
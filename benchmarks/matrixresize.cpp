@@ -0,0 +1,37 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+// Compares growing a large Matrix one row or column at a time with and without the extra capacity
+
+#include "nage/misc/matrix.h"
+#include "benchmark.h"
+
+const unsigned matrixSize = 4096;
+const unsigned steps = 64;
+const unsigned runs = 3;
+
+// Grows a new matrix by one row or column per step, calling shrinkToFit() after each step when exact is true
+// The matrix is created inside of each run, so every run starts without any extra capacity
+void grow(bool rows, bool exact)
+{
+    ng::Matrix<unsigned> matrix(matrixSize, matrixSize);
+    for (unsigned i = 1; i <= steps; ++i)
+    {
+        matrix.resize(matrixSize + (rows ? 0 : i), matrixSize + (rows ? i : 0));
+        if (exact)
+            matrix.shrinkToFit();
+    }
+    keep(matrix(matrixSize - 1, matrixSize - 1));
+}
+
+int main()
+{
+    std::cout << "Growing a " << matrixSize << "x" << matrixSize << " matrix " << steps << " times:\n";
+    double before = measure("One row at a time, exact size", runs, []{ grow(true, true); });
+    double after = measure("One row at a time, with capacity", runs, []{ grow(true, false); });
+    printSpeedup(before, after);
+    before = measure("One column at a time, exact size", runs, []{ grow(false, true); });
+    after = measure("One column at a time, with capacity", runs, []{ grow(false, false); });
+    printSpeedup(before, after);
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+// Compares a 3x3 stencil over each Matrix layout, walking the elements in row order and in column order
+
+#include <string>
+#include "nage/misc/matrix.h"
+#include "benchmark.h"
+
+const unsigned matrixSize = 2048;
+const unsigned passes = 3;
+const unsigned runs = 3;
+
+// Sums the 3x3 neighborhood of each element that isn't on the edge, going down each column first if columns is true
+template <class Layout>
+void stencil(const ng::Matrix<float, Layout>& input, ng::Matrix<float, Layout>& output, bool columns)
+{
+    for (unsigned pass = 0; pass < passes; ++pass)
+    {
+        for (unsigned outer = 1; outer + 1 < matrixSize; ++outer)
+        {
+            for (unsigned inner = 1; inner + 1 < matrixSize; ++inner)
+            {
+                unsigned x = (columns ? outer : inner);
+                unsigned y = (columns ? inner : outer);
+                float sum = 0;
+                for (unsigned dy = 0; dy < 3; ++dy)
+                    for (unsigned dx = 0; dx < 3; ++dx)
+                        sum += input(x + dx - 1, y + dy - 1);
+                output(x, y) = sum;
+            }
+        }
+    }
+}
+
+template <class Layout>
+void compare(const std::string& name)
+{
+    ng::Matrix<float, Layout> input(matrixSize, matrixSize);
+    ng::Matrix<float, Layout> output(matrixSize, matrixSize);
+    unsigned seed = 1;
+    input.transform([&](float){ seed = seed * 1103515245 + 12345; return static_cast<float>(seed >> 16 & 0xFF); });
+    measure(name + " in row order", runs, [&]{ stencil(input, output, false); });
+    measure(name + " in column order", runs, [&]{ stencil(input, output, true); });
+    keep(output(matrixSize / 2, matrixSize / 2));
+}
+
+int main()
+{
+    std::cout << passes << " passes of a 3x3 stencil over a " << matrixSize << "x" << matrixSize << " float matrix:\n";
+    compare<ng::RowMajorLayout>("Row major");
+    compare<ng::TiledLayout<8>>("Tiled 8x8");
+    compare<ng::MortonLayout>("Morton");
+    return 0;
+}
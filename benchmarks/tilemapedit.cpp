@@ -0,0 +1,67 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+// Compares setting every tile of a map with set() to the bulk functions (setRegion, setRow, fill)
+
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "nage/graphics/tilemap.h"
+#include "benchmark.h"
+
+const unsigned mapSize = 1024;
+const unsigned tileSize = 16;
+const unsigned runs = 5;
+const char* tilesetFile = "benchmark_tileset.png";
+
+int main()
+{
+    // Generate a 16x16 tile tileset, so the benchmark doesn't depend on any assets
+    sf::Image image;
+    image.create(tileSize * 16, tileSize * 16, sf::Color::White);
+    if (!image.saveToFile(tilesetFile))
+        return 1;
+
+    ng::TileMap tileMap;
+    if (!tileMap.loadTileset(tilesetFile, tileSize, tileSize))
+        return 1;
+    tileMap.resize(mapSize, mapSize);
+    ng::TileMap::LayerHandle layer = tileMap.getLayer(0);
+    unsigned types = tileMap.getTotalTypes();
+
+    std::vector<unsigned> values(mapSize * mapSize);
+    for (unsigned i = 0; i < values.size(); ++i)
+        values[i] = (i * 7 + i / mapSize) % types;
+
+    std::cout << "Setting " << mapSize << "x" << mapSize << " tiles:\n";
+    double perTile = measure("set() with a layer ID", runs, [&]
+    {
+        for (unsigned y = 0; y < mapSize; ++y)
+            for (unsigned x = 0; x < mapSize; ++x)
+                tileMap.set(0, x, y, values[y * mapSize + x]);
+    });
+    measure("set() with a layer handle", runs, [&]
+    {
+        for (unsigned y = 0; y < mapSize; ++y)
+            for (unsigned x = 0; x < mapSize; ++x)
+                tileMap.set(layer, x, y, values[y * mapSize + x]);
+    });
+    double row = measure("setRow() for each row", runs, [&]
+    {
+        for (unsigned y = 0; y < mapSize; ++y)
+            tileMap.setRow(0, 0, y, &values[y * mapSize], mapSize);
+    });
+    printSpeedup(perTile, row);
+    double region = measure("setRegion() for the whole map", runs, [&]
+    {
+        tileMap.setRegion(0, 0, 0, mapSize, mapSize, values.data());
+    });
+    printSpeedup(perTile, region);
+    unsigned value = 0;
+    double fill = measure("fill()", runs, [&]
+    {
+        tileMap.fill(0, ++value % types);
+    });
+    printSpeedup(perTile, fill);
+    keep(tileMap(0, mapSize - 1, mapSize - 1));
+    return 0;
+}
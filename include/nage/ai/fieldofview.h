@@ -0,0 +1,80 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef FIELDOFVIEW_H
+#define FIELDOFVIEW_H
+
+#include <vector>
+#include <cstdint>
+#include <SFML/System/Vector2.hpp>
+#include "nage/misc/matrix.h"
+#include "nage/misc/bitmatrix.h"
+#include "nage/graphics/tilemap.h"
+
+namespace ng
+{
+
+/*
+This class finds the cells that can be seen from a position on a grid, with recursive shadowcasting.
+Each of the 8 octants around the viewer is scanned row by row, and opaque cells cast shadows
+    that the following rows skip, so every visible cell is only visited once.
+Opaque cells are visible themselves (so walls can be seen), and cells outside of the grid block sight.
+The results are written into a BitMatrix the size of the grid.
+Many viewers (like all of the AI units) can be computed at once, in parallel on the engine's thread pool.
+
+Example:
+    FieldOfView fov;
+    fov.setGrid(tileMap, tileMap.getLayer(0), Opaque);
+    BitMatrix visible;
+    fov.compute(player.cell, 10, visible);
+    fog.update(visible);
+*/
+class FieldOfView
+{
+    public:
+        struct Viewer
+        {
+            sf::Vector2u position;
+            unsigned radius;
+        };
+
+        FieldOfView();
+
+        // Sets the grid from a matrix of costs, where cells with a cost of 0 block sight (like Pathfinder)
+        void setGrid(const Matrix<unsigned>& costs);
+
+        // Sets the grid from a layer of a tile map, where tiles with any of the properties block sight
+        void setGrid(const TileMap& tileMap, TileMap::LayerHandle layer, std::uint32_t opaque);
+
+        void setOpaque(unsigned x, unsigned y, bool opaque);
+        bool isOpaque(unsigned x, unsigned y) const;
+
+        sf::Vector2u getSize() const;
+
+        // Finds the cells visible from a position within a radius, replacing the contents of visible
+        void compute(const sf::Vector2u& position, unsigned radius, BitMatrix& visible) const;
+
+        // Marks the cells visible from a position within a radius, keeping the bits that are already set
+        void add(const sf::Vector2u& position, unsigned radius, BitMatrix& visible) const;
+
+        // Finds the cells visible from any of the viewers (like the units of a team)
+        void compute(const std::vector<Viewer>& viewers, BitMatrix& visible) const;
+
+        // Finds the cells visible from each of the viewers separately (like for AI units)
+        void computeEach(const std::vector<Viewer>& viewers, std::vector<BitMatrix>& results) const;
+
+    private:
+        // Scans the rows of an octant, starting at a row and between two slopes
+        // The multipliers transform the octant's coordinates into grid coordinates
+        void castLight(const sf::Vector2u& position, unsigned radius, unsigned row, float start, float end,
+            int xx, int xy, int yx, int yy, BitMatrix& visible) const;
+
+        // Sizes a result to the grid, and clears it if it already was
+        void prepare(BitMatrix& visible) const;
+
+        BitMatrix opaqueCells;
+};
+
+}
+
+#endif
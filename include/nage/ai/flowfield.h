@@ -0,0 +1,70 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+#include <cstdint>
+#include <SFML/System/Vector2.hpp>
+#include "nage/misc/matrix.h"
+
+namespace ng
+{
+
+/*
+This class steers any number of units towards a single goal on a grid.
+build() computes an integration field (the cost from every cell to the goal),
+    and then a direction field pointing each cell at its cheapest neighbor.
+    Afterwards, steering a unit is only a lookup, so one field can be shared by a whole crowd.
+Each cell has a movement cost, where 0 means the cell is blocked.
+    Units move in 8 directions, but can't cut the corners of blocked cells.
+The integration can optionally run in parallel by wavefront, which is faster on large open grids with many cores.
+    Otherwise it runs Dijkstra on the calling thread. Both give the same costs.
+
+Example:
+    FlowField field;
+    field.build(costs, goal);
+    for (auto& unit: units)
+        unit.velocity = field.getDirection(unit.position, tileSize) * unit.speed;
+*/
+class FlowField
+{
+    public:
+        FlowField();
+
+        // Computes the fields for a goal on a grid of costs
+        void build(const Matrix<unsigned>& costs, const sf::Vector2u& goal, bool parallel = false);
+
+        const sf::Vector2u& getGoal() const;
+        sf::Vector2u getSize() const;
+
+        // Returns the cost of moving from a cell to the goal, which is infinity if the goal can't be reached
+        float getCost(unsigned x, unsigned y) const;
+        bool isReachable(unsigned x, unsigned y) const;
+
+        // Returns the unit vector to move along from a cell, or (0, 0) at the goal and on unreachable cells
+        const sf::Vector2f& getDirection(unsigned x, unsigned y) const;
+
+        // Returns the direction of the cell under a position in pixels
+        const sf::Vector2f& getDirection(const sf::Vector2f& position, const sf::Vector2f& tileSize) const;
+
+    private:
+        // Runs Dijkstra from the goal
+        void integrate(const Matrix<unsigned>& costs);
+
+        // Relaxes the cells next to the last changed cells in parallel, until nothing changes
+        void integrateParallel(const Matrix<unsigned>& costs);
+
+        // Points every cell at its cheapest neighbor
+        void buildDirections(const Matrix<unsigned>& costs, bool parallel);
+
+        static const std::uint8_t noDirection = 8;
+
+        sf::Vector2u goal;
+        Matrix<float> integration;
+        Matrix<std::uint8_t> directions; // Indexes into the table of unit vectors
+};
+
+}
+
+#endif
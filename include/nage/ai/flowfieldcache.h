@@ -0,0 +1,81 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef FLOWFIELDCACHE_H
+#define FLOWFIELDCACHE_H
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include "nage/ai/flowfield.h"
+
+namespace ng
+{
+
+/*
+This class keeps the flow fields of the most recently used goals on a grid.
+Every unit heading to the same goal gets the same field, which is only built the first time it is requested.
+    When there are more fields than the capacity, the least recently used ones are removed.
+Fields are returned as shared pointers, so units can keep using a field after it is removed from the cache.
+Changing the grid removes all of the fields, since any of them could have changed.
+
+Example:
+    FlowFieldCache flowFields(16);
+    flowFields.setGrid(costs);
+    // Every frame:
+    for (auto& unit: units)
+    {
+        auto field = flowFields.get(unit.goal);
+        unit.velocity = field->getDirection(unit.position, tileSize) * unit.speed;
+    }
+*/
+class FlowFieldCache
+{
+    public:
+        using FieldPtr = std::shared_ptr<const FlowField>;
+
+        explicit FlowFieldCache(unsigned capacity = 8);
+
+        // Sets the grid of costs (0 is blocked), and removes all of the fields
+        void setGrid(const Matrix<unsigned>& costs);
+
+        // Changes the cost of a cell, and removes all of the fields
+        void setCost(unsigned x, unsigned y, unsigned cost);
+        unsigned getCost(unsigned x, unsigned y) const;
+
+        // Sets the maximum number of fields to keep (removing the oldest ones if needed)
+        void setCapacity(unsigned capacity);
+
+        // Sets whether new fields are integrated in parallel
+        void setParallel(bool parallel);
+
+        // Returns the field for a goal, building it if it isn't cached
+        FieldPtr get(const sf::Vector2u& goal);
+
+        // Returns true if the field for a goal is cached
+        bool contains(const sf::Vector2u& goal) const;
+
+        // Removes all of the fields
+        void clear();
+
+        unsigned getFieldCount() const;
+
+    private:
+        using FieldList = std::list<std::pair<std::uint64_t, FieldPtr>>; // Goal key and field, most recently used first
+
+        static std::uint64_t getKey(const sf::Vector2u& goal);
+
+        // Removes the least recently used fields until there are no more than the capacity
+        void evict();
+
+        Matrix<unsigned> costs;
+        unsigned capacity;
+        bool parallel;
+        FieldList fields;
+        std::unordered_map<std::uint64_t, FieldList::iterator> fieldIndexes;
+};
+
+}
+
+#endif
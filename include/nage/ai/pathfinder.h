@@ -0,0 +1,141 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef PATHFINDER_H
+#define PATHFINDER_H
+
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstdint>
+#include <SFML/System/Vector2.hpp>
+#include "nage/misc/matrix.h"
+#include "nage/graphics/tilemap.h"
+
+namespace ng
+{
+
+/*
+This class finds paths on large grids with hierarchical A* (HPA*).
+The grid is split into square clusters, and the walkable openings between neighboring clusters
+    become the nodes of a small abstract graph, with the costs between the nodes of each cluster precomputed.
+    A query searches the abstract graph, and then refines each step with A* inside a single cluster.
+    The resulting path is smoothed by skipping cells that have a clear straight line between them.
+Each cell has a movement cost, where 0 means the cell is blocked.
+    Units move in 8 directions, but can't cut the corners of blocked cells.
+Changing cells only marks their clusters as dirty, and update() rebuilds just those clusters.
+findPath() can be called from many threads at once, and waits while the grid is being changed.
+
+Example:
+    Pathfinder pathfinder;
+    pathfinder.setGrid(tileMap, tileMap.getLayer(0), Solid);
+    std::vector<sf::Vector2u> path;
+    if (pathfinder.findPath(start, goal, path))
+        followPath(path);
+*/
+class Pathfinder
+{
+    public:
+        explicit Pathfinder(unsigned clusterSize = 16);
+
+        // Sets the grid from a matrix of costs (0 is blocked), and builds the abstract graph
+        void setGrid(const Matrix<unsigned>& costs);
+
+        // Sets the grid from a layer of a tile map, where tiles with any of the properties are blocked
+        void setGrid(const TileMap& tileMap, TileMap::LayerHandle layer, std::uint32_t blocking);
+
+        // Changes the cost of a cell (call update() afterwards to rebuild its cluster)
+        void setCost(unsigned x, unsigned y, unsigned cost);
+        unsigned getCost(unsigned x, unsigned y) const;
+
+        // Rebuilds the clusters that have changed since the last update
+        void update();
+
+        // Finds a path of cells from start to goal (including both), and returns true if one was found
+        // If smooth is true, only the cells where the path turns are kept
+        bool findPath(const sf::Vector2u& start, const sf::Vector2u& goal, std::vector<sf::Vector2u>& path, bool smooth = true) const;
+
+        // Returns the number of nodes in the abstract graph
+        unsigned getNodeCount() const;
+
+    private:
+        // A rectangle of cells that a low level search stays in
+        struct Area
+        {
+            unsigned x, y, width, height;
+        };
+
+        // A pair of neighboring walkable cells on the border between two clusters
+        struct Transition
+        {
+            unsigned cellA; // In the west or north cluster
+            unsigned cellB; // In the east or south cluster
+            float cost;
+        };
+
+        struct Cluster
+        {
+            std::vector<Transition> east; // Transitions to the cluster to the east
+            std::vector<Transition> south; // Transitions to the cluster to the south
+            std::vector<unsigned> nodes; // Cells on the borders with transitions
+            std::vector<float> distances; // Costs between each pair of nodes (nodes * nodes)
+        };
+
+        // Builds all of the clusters from scratch
+        void build();
+
+        // Finds the transitions of the east or south border of a cluster
+        void buildBorder(unsigned clusterX, unsigned clusterY, bool east);
+
+        // Finds the nodes of a cluster from its borders, and the costs between them
+        void buildNodes(unsigned clusterX, unsigned clusterY);
+
+        // Runs A* from start to goal inside of an area, or Dijkstra to every cell if goal is noCell
+        // costs and parents are indexed by position in the area
+        void search(const Area& area, unsigned start, unsigned goal, std::vector<float>& costs, std::vector<unsigned>& parents) const;
+
+        // Finds a path of cells inside of an area, and appends it (without the start cell) to path
+        bool searchPath(const Area& area, unsigned start, unsigned goal, std::vector<unsigned>& path) const;
+
+        // Searches the abstract graph, and refines the result into a path of cells
+        bool searchAbstract(unsigned start, unsigned goal, std::vector<unsigned>& path) const;
+
+        // Removes cells that can be skipped with a straight line that isn't more expensive
+        void smoothPath(std::vector<unsigned>& path) const;
+
+        // Returns true if every cell the line between two cells touches is walkable and no more expensive than maxCost
+        bool isLineClear(unsigned from, unsigned to, unsigned maxCost) const;
+
+        // Returns the cost of a cell from its index
+        unsigned getCellCost(unsigned cell) const;
+
+        // Returns the cost of moving between two neighboring cells
+        float getStepCost(unsigned from, unsigned to) const;
+
+        // Returns true if a unit can move from a cell in a direction without cutting a corner
+        bool canStep(unsigned x, unsigned y, int dx, int dy) const;
+
+        // Returns the lowest possible cost between two cells
+        float getHeuristic(unsigned from, unsigned to) const;
+
+        Area getClusterArea(unsigned cluster) const;
+        unsigned getCluster(unsigned cell) const;
+
+        // Appends the transitions that touch a cell of a cluster, and the cells on the other side
+        void getTransitions(unsigned cluster, unsigned cell, std::vector<std::pair<unsigned, float>>& neighbors) const;
+
+        static const unsigned noCell;
+
+        unsigned clusterSize;
+        sf::Vector2u clusterCount;
+        Matrix<unsigned> costs;
+        std::vector<Cluster> clusters;
+        std::unordered_map<unsigned, unsigned> nodeIndexes; // Node cell -> index in its cluster's nodes
+        std::vector<bool> dirty; // Clusters that have changed
+        std::vector<unsigned> dirtyClusters;
+        mutable std::shared_timed_mutex mutex;
+};
+
+}
+
+#endif
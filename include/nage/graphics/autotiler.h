@@ -0,0 +1,107 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef AUTOTILER_H
+#define AUTOTILER_H
+
+#include <string>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include "nage/graphics/tilemap.h"
+#include "nage/misc/matrix.h"
+#include "nage/misc/bitmatrix.h"
+
+namespace ng
+{
+
+class TileJournal;
+
+/*
+This class paints terrain onto a layer of a tile map, and picks the tiles to use automatically.
+It uses "blob" autotiling, where each tile depends on which of its 8 neighbors have the same terrain.
+    A corner neighbor only counts when both of the edges next to it match, which leaves 47 cases.
+    So each terrain has 47 tiles, in the order of getBlobIndex().
+Only the 3x3 neighborhood of a painted cell is recomputed.
+    Bulk paints collect all of the dirty cells first, so each tile is only rewritten once.
+Terrain 0 means no terrain, and those tiles are set to ID 0.
+Cells outside of the map count as the same terrain, so terrain continues past the edges.
+The tiles can be written through a tile journal, so autotiled terrain can be undone and saved like other edits.
+Note: The autotiler keeps its own terrain grid, so tiles of its layer shouldn't be set directly.
+    Undoing through the journal only reverts the tiles, so paint over them again to change their terrain.
+
+Config file format (each section is a terrain):
+    [Grass]
+    terrain = 1
+    tiles = {10, 11, 12, ...} // 47 tile IDs
+*/
+class AutoTiler
+{
+    public:
+        // The bits of the neighbor mask
+        enum Neighbor
+        {
+            North = 1,
+            NorthEast = 2,
+            East = 4,
+            SouthEast = 8,
+            South = 16,
+            SouthWest = 32,
+            West = 64,
+            NorthWest = 128
+        };
+
+        static const unsigned blobTiles = 47;
+
+        AutoTiler(TileMap& tileMap, int layer);
+
+        // Writes the tiles through a journal instead of directly to the tile map (nullptr to stop)
+        void setJournal(TileJournal* journal);
+
+        // Loads the terrains from a config file
+        bool loadFromConfig(const std::string& filename);
+
+        // Sets the 47 tile IDs of a terrain (terrain 0 can't be changed)
+        bool addTerrain(unsigned terrain, const std::vector<unsigned>& tiles);
+
+        // Paints a single cell, and updates the tiles around it
+        void paint(unsigned x, unsigned y, unsigned terrain);
+
+        // Paints many cells at once, rewriting each affected tile only once
+        void paintRegion(unsigned x, unsigned y, unsigned width, unsigned height, unsigned terrain);
+        void paintCells(const std::vector<sf::Vector2u>& cells, unsigned terrain);
+
+        // Returns the terrain of a cell (0 if it is out of bounds)
+        unsigned getTerrain(unsigned x, unsigned y) const;
+
+        // Returns the index (0 to 46) of the tile to use for a mask of matching neighbors
+        static unsigned getBlobIndex(unsigned neighbors);
+
+    private:
+        // Resets the terrain grid if the size of the tile map changed
+        void resize();
+
+        // Sets the terrain of a cell, and marks its neighborhood as dirty
+        void setTerrain(unsigned x, unsigned y, unsigned terrain);
+
+        // Rewrites the tiles of all of the dirty cells
+        void flush();
+
+        // Returns the mask of neighbors with the same terrain as a cell
+        unsigned getNeighbors(unsigned x, unsigned y) const;
+
+        // Returns true if a cell is out of bounds or has the same terrain
+        bool matches(int x, int y, unsigned terrain) const;
+
+        TileMap& tileMap;
+        TileMap::LayerHandle layer;
+        int layerId;
+        TileJournal* journal;
+        Matrix<unsigned> terrains;
+        std::vector<std::vector<unsigned>> terrainTiles; // Terrain -> tile IDs in blob order
+        BitMatrix dirty; // Cells that are in dirtyCells
+        std::vector<sf::Vector2u> dirtyCells;
+};
+
+}
+
+#endif
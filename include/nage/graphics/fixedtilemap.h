@@ -0,0 +1,136 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef FIXEDTILEMAP_H
+#define FIXEDTILEMAP_H
+
+#include <cmath>
+#include "nage/graphics/tilemap.h"
+
+namespace ng
+{
+
+/*
+This class is a TileMap with a tile size that is fixed at compile time, and must be a power of two.
+The conversions between tiles and pixels become shifts and masks instead of multiplies and divides,
+    which matters when they are done for every entity or particle on every frame.
+It is still a TileMap, so it can be used anywhere one is expected (pathfinding, lighting, etc.)
+    The functions with the same names as TileMap's hide them, so calls through a FixedTileMap use the fast versions.
+Loading a tileset, file, or config with a different tile size fails and leaves the map as it was.
+    The tile size is checked inside TileMap, so this also holds for calls through a TileMap reference.
+
+Example:
+    FixedTileMap<16> tileMap;
+    tileMap.loadTileset("tiles.png");
+    tileMap.resize(256, 256);
+    sf::Vector2i tile = tileMap.getTilePosition(mousePosition);
+*/
+template <unsigned TileWidth, unsigned TileHeight = TileWidth>
+class FixedTileMap: public TileMap
+{
+    static_assert(TileWidth && !(TileWidth & (TileWidth - 1)), "The tile width must be a power of two");
+    static_assert(TileHeight && !(TileHeight & (TileHeight - 1)), "The tile height must be a power of two");
+
+    // Returns the base 2 logarithm of a power of two
+    static constexpr unsigned log2(unsigned value)
+    {
+        return (value > 1 ? 1 + log2(value >> 1) : 0);
+    }
+
+    public:
+        static const unsigned tileWidth = TileWidth;
+        static const unsigned tileHeight = TileHeight;
+        static const unsigned shiftX = log2(TileWidth);
+        static const unsigned shiftY = log2(TileHeight);
+
+        FixedTileMap();
+
+        // Loads the texture to use for the tiles, which are always TileWidth by TileHeight
+        bool loadTileset(const std::string& filename, unsigned types = 0, unsigned padding = 0);
+
+        // The size of the tile map in pixels
+        sf::Vector2u getPixelSize() const;
+
+        // Returns the bounding box rectangle of a tile
+        sf::FloatRect getBoundingBox(unsigned x, unsigned y) const;
+
+        // Returns the graphical center position of a tile from coordinates
+        template <typename T>
+        sf::Vector2<T> getCenterPoint(unsigned x, unsigned y) const;
+
+        // Returns the graphical center position of a tile from a vector
+        template <typename T1, typename T2>
+        sf::Vector2<T1> getCenterPoint(const sf::Vector2<T2>& pos) const;
+
+        // Returns the tile containing a position in local pixel coordinates (can be out of bounds or negative)
+        static sf::Vector2i getTilePosition(const sf::Vector2f& position);
+        static sf::Vector2i getTilePosition(const sf::Vector2i& position);
+
+        // Returns a position relative to the top left corner of the tile that contains it
+        static sf::Vector2i getOffsetInTile(const sf::Vector2i& position);
+};
+
+template <unsigned TileWidth, unsigned TileHeight>
+FixedTileMap<TileWidth, TileHeight>::FixedTileMap():
+    TileMap(TileWidth, TileHeight)
+{
+}
+
+template <unsigned TileWidth, unsigned TileHeight>
+bool FixedTileMap<TileWidth, TileHeight>::loadTileset(const std::string& filename, unsigned types, unsigned padding)
+{
+    return TileMap::loadTileset(filename, TileWidth, TileHeight, types, padding);
+}
+
+template <unsigned TileWidth, unsigned TileHeight>
+sf::Vector2u FixedTileMap<TileWidth, TileHeight>::getPixelSize() const
+{
+    const sf::Vector2u& mapSize = getMapSize();
+    return sf::Vector2u(mapSize.x << shiftX, mapSize.y << shiftY);
+}
+
+template <unsigned TileWidth, unsigned TileHeight>
+sf::FloatRect FixedTileMap<TileWidth, TileHeight>::getBoundingBox(unsigned x, unsigned y) const
+{
+    return sf::FloatRect(x << shiftX, y << shiftY, TileWidth, TileHeight);
+}
+
+template <unsigned TileWidth, unsigned TileHeight>
+template <typename T>
+sf::Vector2<T> FixedTileMap<TileWidth, TileHeight>::getCenterPoint(unsigned x, unsigned y) const
+{
+    return sf::Vector2<T>((x << shiftX) + (TileWidth / static_cast<T>(2)),
+                          (y << shiftY) + (TileHeight / static_cast<T>(2)));
+}
+
+template <unsigned TileWidth, unsigned TileHeight>
+template <typename T1, typename T2>
+sf::Vector2<T1> FixedTileMap<TileWidth, TileHeight>::getCenterPoint(const sf::Vector2<T2>& pos) const
+{
+    return getCenterPoint<T1>(static_cast<unsigned>(pos.x), static_cast<unsigned>(pos.y));
+}
+
+template <unsigned TileWidth, unsigned TileHeight>
+sf::Vector2i FixedTileMap<TileWidth, TileHeight>::getTilePosition(const sf::Vector2f& position)
+{
+    return getTilePosition(sf::Vector2i(static_cast<int>(std::floor(position.x)), static_cast<int>(std::floor(position.y))));
+}
+
+template <unsigned TileWidth, unsigned TileHeight>
+sf::Vector2i FixedTileMap<TileWidth, TileHeight>::getTilePosition(const sf::Vector2i& position)
+{
+    // Shifting a negative int right is implementation defined, so negative positions shift their complement instead,
+    // which rounds towards negative infinity and maps them to the correct tile
+    return sf::Vector2i(position.x >= 0 ? position.x >> shiftX : ~(~position.x >> shiftX),
+                        position.y >= 0 ? position.y >> shiftY : ~(~position.y >> shiftY));
+}
+
+template <unsigned TileWidth, unsigned TileHeight>
+sf::Vector2i FixedTileMap<TileWidth, TileHeight>::getOffsetInTile(const sf::Vector2i& position)
+{
+    return sf::Vector2i(position.x & (TileWidth - 1), position.y & (TileHeight - 1));
+}
+
+}
+
+#endif
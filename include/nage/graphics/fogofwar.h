@@ -0,0 +1,72 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef FOGOFWAR_H
+#define FOGOFWAR_H
+
+#include <SFML/Graphics.hpp>
+#include "nage/graphics/tilemap.h"
+#include "nage/misc/bitmatrix.h"
+
+namespace ng
+{
+
+/*
+This class tints a layer of a tile map with fog of war.
+Every tile is either hidden (never seen), explored (seen before), or visible (seen right now),
+    and each of these states has a color that is applied to the tile's vertices.
+update() compares the new visible cells with the last ones a word at a time,
+    so only the tiles that actually changed get new colors.
+The layer can be the ground layer itself, or a separate layer filled with a fog tile drawn on top.
+    Tiles added to sparse layers later need a call to refresh() to get their fog color.
+
+Example:
+    FogOfWar fog(tileMap, tileMap.getLayer(0));
+    fog.setColors(sf::Color::Black, sf::Color(128, 128, 128), sf::Color::White);
+    // Every frame:
+    fov.compute(player.cell, 10, visible);
+    fog.update(visible);
+*/
+class FogOfWar
+{
+    public:
+        FogOfWar(TileMap& tileMap, TileMap::LayerHandle layer);
+
+        // Sets the colors of the states, and applies them to every tile
+        void setColors(const sf::Color& hidden, const sf::Color& explored, const sf::Color& visible);
+
+        // Sets the visible cells (which also become explored), and recolors the tiles that changed
+        void update(const BitMatrix& visible);
+
+        // Forgets the explored cells, so every tile is hidden again
+        void reset();
+
+        // Applies the colors to every tile again
+        void refresh();
+
+        bool isVisible(unsigned x, unsigned y) const;
+        bool isExplored(unsigned x, unsigned y) const;
+
+        // Returns the number of tiles recolored by the last update
+        unsigned getChangedCount() const;
+
+    private:
+        // Matches the size of the states to the tile map, resetting them if it changed
+        void checkSize();
+
+        void applyColor(unsigned x, unsigned y);
+
+        TileMap& tileMap;
+        TileMap::LayerHandle layer;
+        BitMatrix visibleCells;
+        BitMatrix exploredCells;
+        BitMatrix changedCells;
+        sf::Color hiddenColor;
+        sf::Color exploredColor;
+        sf::Color visibleColor;
+        unsigned changedCount;
+};
+
+}
+
+#endif
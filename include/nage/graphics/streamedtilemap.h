@@ -0,0 +1,123 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef STREAMEDTILEMAP_H
+#define STREAMEDTILEMAP_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <SFML/Graphics.hpp>
+#include "nage/graphics/tileset.h"
+
+namespace ng
+{
+
+/*
+This class draws a tile map that is too large to keep in memory, by streaming it from disk.
+The world is a directory of chunk files, each holding the tile IDs of every layer
+    for a square of TileMap::chunkSize tiles (see saveChunk()).
+    Chunk coordinates can be negative, and missing chunk files are treated as empty.
+Only the chunks within a radius of the focus point (usually the camera center) are kept in memory.
+    Chunks are read, decoded, and have their vertices built on a background thread.
+    update() only picks up the finished chunks, so the main thread never waits on the disk.
+Tiles with an ID of 0 are empty, and are not drawn.
+
+Example:
+    StreamedTileMap world;
+    world.loadTileset("tiles.png", 16, 16);
+    world.setRadius(3);
+    world.setWorld("data/world");
+    // Every frame:
+    world.setFocus(camera.getView("Game").getCenter());
+    world.update();
+    window.draw(world);
+*/
+class StreamedTileMap: public sf::Drawable, public sf::Transformable
+{
+    public:
+        StreamedTileMap();
+        ~StreamedTileMap();
+
+        // Loads a texture to use for the tile set (must be called before setWorld())
+        bool loadTileset(const std::string& filename, unsigned tileWidth, unsigned tileHeight, unsigned types = 0, unsigned padding = 0);
+
+        // Starts streaming chunks from a world directory (unloads all of the current chunks)
+        void setWorld(const std::string& directory);
+
+        // Sets how many chunks in each direction around the focus chunk are kept in memory
+        void setRadius(unsigned radius);
+
+        // Sets the point to keep the chunks around, in pixels
+        void setFocus(const sf::Vector2f& center);
+
+        // Picks up the chunks that finished loading, requests missing ones, and evicts far away ones
+        void update();
+
+        // Returns the ID of a tile, or 0 if its chunk is not loaded
+        unsigned operator()(unsigned layer, int x, int y) const;
+
+        // Returns true if a chunk is in memory
+        bool isLoaded(int chunkX, int chunkY) const;
+
+        // Returns the number of chunks in memory
+        unsigned getLoadedCount() const;
+
+        // Writes a chunk file to a world directory (each layer must have chunkSize * chunkSize IDs)
+        static bool saveChunk(const std::string& directory, int chunkX, int chunkY, const std::vector<std::vector<unsigned>>& layers);
+
+        // Draws the loaded chunks that intersect the target's view
+        virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+
+    private:
+        struct Chunk
+        {
+            sf::Vector2i position; // In chunks
+            std::vector<std::vector<unsigned>> layers; // Tile IDs of each layer
+            std::vector<sf::VertexArray> vertices; // Quads of the non-empty tiles of each layer
+        };
+
+        using ChunkKey = std::uint64_t;
+        using ChunkPtr = std::unique_ptr<Chunk>;
+
+        static ChunkKey makeKey(int chunkX, int chunkY);
+        static std::string getChunkFilename(const std::string& directory, int chunkX, int chunkY);
+
+        // Returns true if a chunk is close enough to the focus point to be kept
+        bool inRadius(const sf::Vector2i& position) const;
+
+        void startThread();
+        void stopThread();
+
+        // Runs on the background thread, loading the requested chunks
+        void run();
+
+        // Reads a chunk file and builds its vertices (runs on the background thread)
+        ChunkPtr loadChunk(const sf::Vector2i& position) const;
+
+        Tileset tileset;
+        std::string worldDirectory;
+        unsigned radius; // In chunks
+        sf::Vector2i focusChunk;
+        std::unordered_map<ChunkKey, ChunkPtr> chunks; // Loaded chunks
+        std::unordered_set<ChunkKey> pending; // Chunks that were requested, but haven't been picked up yet
+
+        // Shared with the background thread
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<sf::Vector2i> requests; // Chunks to load, closest first
+        std::vector<ChunkPtr> finished; // Chunks that are done loading
+        bool running;
+};
+
+}
+
+#endif
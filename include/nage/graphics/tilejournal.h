@@ -0,0 +1,134 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef TILEJOURNAL_H
+#define TILEJOURNAL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "nage/graphics/tilemap.h"
+
+namespace ng
+{
+
+/*
+This class records every tile change made through it, for undo/redo, saving, and replication.
+Changes are grouped into actions with commit(), and each action is one undo step.
+    Neighboring cells with the same old and new IDs are stored as a single run,
+    so filling or pasting a region costs a few bytes instead of a copy of the layer.
+    Cell positions are stored as the distance from the end of the previous run, in variable length integers.
+Committed actions can be appended to a journal file, which is written on a background thread.
+    The file only holds the changes, so a save is the base map plus the journal.
+    Undoing and redoing also append actions, so replaying the whole file gives the current map.
+Cells are stored as indexes, so the map size must not change while the journal is in use.
+    The map size is saved in the journal file, and replaying or appending to it fails on a map of a different size.
+Only the changes made through the journal are recorded, so other classes that edit tiles can write through one
+    (like AutoTiler), and the tiles are read back after each change, so IDs the tile map rejected aren't recorded.
+
+Example:
+    TileJournal journal(tileMap);
+    journal.open("saves/edits.ngtj");
+    journal.fill(0, 10, 10, 5, 5, grass);
+    journal.set(1, 12, 12, tree);
+    journal.commit();
+    journal.undo();
+    // Later, after loading the base map:
+    TileJournal::replay(tileMap, "saves/edits.ngtj");
+*/
+class TileJournal
+{
+    public:
+        explicit TileJournal(TileMap& tileMap);
+        ~TileJournal();
+
+        // Starts appending the committed actions to a journal file
+        bool open(const std::string& filename);
+
+        // Finishes writing the pending actions, and closes the journal file
+        void close();
+
+        // Changes tiles of the tile map, and records the changes in the current action
+        void set(int layer, unsigned x, unsigned y, unsigned value);
+        void setRegion(int layer, unsigned x, unsigned y, unsigned width, unsigned height, const unsigned* values);
+        void fill(int layer, unsigned x, unsigned y, unsigned width, unsigned height, unsigned value);
+
+        // Ends the current action, and returns false if it didn't change anything
+        bool commit();
+
+        // Reverts or reapplies a committed action, and returns false if there is none
+        bool undo();
+        bool redo();
+        bool canUndo() const;
+        bool canRedo() const;
+
+        // Sets the number of actions to keep for undoing (the oldest ones are dropped)
+        void setHistoryLimit(unsigned actions);
+        void clearHistory();
+
+        // Returns the size of the encoded undo and redo history in bytes
+        std::size_t getHistoryBytes() const;
+
+        // Applies all of the actions of a journal file to a tile map
+        static bool replay(TileMap& tileMap, const std::string& filename);
+
+    private:
+        // Consecutive cells of a layer that changed from the same ID to the same ID
+        struct Run
+        {
+            int layer;
+            unsigned cell;
+            unsigned count;
+            unsigned oldValue;
+            unsigned value;
+        };
+
+        using Action = std::vector<std::uint8_t>;
+
+        // Records a change in the current action, extending the last run if possible
+        void record(int layer, unsigned cell, unsigned oldValue, unsigned value);
+
+        // Gets the IDs of the tiles [x, endX) by [y, endY) in row-major order, before they are changed
+        void getRegion(int layer, unsigned x, unsigned y, unsigned endX, unsigned endY, std::vector<unsigned>& values) const;
+
+        // Records the tiles of a region that are different from their old IDs, after it was changed
+        void recordRegion(int layer, unsigned x, unsigned y, unsigned endX, unsigned endY, const std::vector<unsigned>& oldValues);
+
+        static void encode(const std::vector<Run>& runs, Action& action);
+        static bool decode(const std::uint8_t* data, std::size_t size, std::vector<Run>& runs);
+
+        // Sets the new IDs of runs in order, or the old IDs in reverse order when undoing
+        static void apply(TileMap& tileMap, const std::vector<Run>& runs, bool undoing);
+
+        // Queues an action to be appended to the journal file
+        void write(const Action& action);
+
+        void startThread();
+        void stopThread();
+
+        // Runs on the background thread, writing the queued actions
+        void run();
+
+        TileMap& tileMap;
+        std::vector<Run> current; // The uncommitted action
+        std::deque<Action> undoActions;
+        std::vector<Action> redoActions;
+        unsigned historyLimit;
+
+        // Shared with the background thread
+        std::ofstream file;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<Action> writes; // Actions to append, oldest first
+        bool running;
+};
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef TILELIGHTING_H
+#define TILELIGHTING_H
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <SFML/Graphics.hpp>
+#include "nage/graphics/tilemap.h"
+#include "nage/misc/matrix.h"
+#include "nage/misc/bitmatrix.h"
+
+namespace ng
+{
+
+/*
+This class lights the tiles of a tile map with flood fill lighting, like in block building games.
+Light sources have a level from 1 to maxLevel, which goes down by 1 for each tile it spreads to (in 4 directions).
+    Opaque tiles are lit by their neighbors, but don't let the light through.
+    Sources on opaque tiles only light that tile.
+Changing a source or an opaque tile only relights the tiles within reach of it:
+    the old light is removed with a breadth first search, and then the light around its edges spreads back in.
+The levels are shown as vertex colors of the lit layers, and only the tiles that changed get new colors in update().
+
+Example:
+    TileLighting lighting(tileMap);
+    lighting.addLayer(tileMap.getLayer(0));
+    lighting.setOpaqueProperties(tileMap.getLayer(0), Solid);
+    lighting.setSource(torch.x, torch.y, 12);
+    // Every frame:
+    lighting.update();
+*/
+class TileLighting
+{
+    public:
+        static const unsigned maxLevel = 15;
+
+        explicit TileLighting(TileMap& tileMap);
+
+        // Adds a layer to apply the light colors to
+        void addLayer(TileMap::LayerHandle layer);
+
+        // Sets the colors of the darkest and brightest levels, with the ones between blended (recolors every tile)
+        void setColors(const sf::Color& dark, const sf::Color& bright);
+
+        // Sets which tiles are opaque from the properties of a layer, and relights the whole map
+        void setOpaqueProperties(TileMap::LayerHandle layer, std::uint32_t properties);
+
+        // Sets whether a tile blocks light (like when placing or removing a block)
+        void setOpaque(unsigned x, unsigned y, bool opaque);
+        bool isOpaque(unsigned x, unsigned y) const;
+
+        // Sets the level of light a tile emits (0 removes the source)
+        void setSource(unsigned x, unsigned y, unsigned level);
+        unsigned getSource(unsigned x, unsigned y) const;
+
+        // Returns the level of light on a tile
+        unsigned getLevel(unsigned x, unsigned y) const;
+
+        // Spreads the light of every source over the whole map from scratch
+        void relight();
+
+        // Applies the colors of the tiles whose light changed since the last update
+        void update();
+
+        // Returns the number of tiles that will be recolored by the next update
+        unsigned getDirtyCount() const;
+
+    private:
+        struct Removal
+        {
+            unsigned cell;
+            unsigned level; // The level the cell had before it was removed
+        };
+
+        // Matches the size of the grids to the tile map, clearing them if it changed
+        void checkSize();
+
+        // Removes the light that a cell with an old level spread, and spreads the remaining light back in
+        void removeLight(unsigned cell, unsigned oldLevel);
+
+        // Spreads the light of the cells in the queue to their neighbors
+        void spreadLight();
+
+        // Lights opaque cells that were cleared from their brightest open neighbor
+        void relightOpaque();
+
+        // Returns the brightest level an open neighbor of a cell gives it
+        unsigned getNeighborLevel(unsigned cell) const;
+
+        // Changes the level of a cell, and marks it to be recolored
+        void setLevel(unsigned cell, unsigned level);
+
+        void applyColor(unsigned x, unsigned y);
+
+        TileMap& tileMap;
+        std::vector<TileMap::LayerHandle> layers;
+        unsigned width;
+        unsigned height;
+        Matrix<std::uint8_t> levels;
+        Matrix<std::uint8_t> sources;
+        BitMatrix opaqueCells;
+        BitMatrix dirty;
+        std::vector<unsigned> dirtyCells;
+        std::deque<unsigned> spreadQueue;
+        std::deque<Removal> removalQueue;
+        std::vector<unsigned> clearedOpaque;
+        sf::Color colors[maxLevel + 1];
+};
+
+}
+
+#endif
@@ -5,8 +5,14 @@
 #define TILEMAP_H
 
 #include <vector>
+#include <deque>
+#include <cstdint>
+#include <future>
 #include <map>
+#include <unordered_map>
 #include <SFML/Graphics.hpp>
+#include "nage/graphics/tileset.h"
+#include "nage/misc/bitmatrix.h"
 
 namespace ng
 {
@@ -18,33 +24,107 @@ The tile size and map size can be set.
     Note: Changing this after setting the tiles will reset everything.
 A tileset (in a single texture) must be specified with the tile size, as well as the
     total number of tiles. The rest is automatically calculated (tiles per row, etc.)
+More tilesets can be added, and their IDs start after the IDs of the previous tilesets.
+    A layer can mix tiles from any of the tilesets.
 It uses vertex arrays for performance.
-    Note: This means that only one texture can be used.
+    Each chunk has a vertex array per tileset it uses, so there is one draw call per chunk and texture.
+    Large rebuilds (resizing, setting regions, and changing the color) are split across a thread pool.
+Each layer is split into square chunks of tiles, and only the chunks that intersect
+    the view of the render target are drawn, so the cost scales with the visible area.
 Multiple layers are supported, and you can use your own integer IDs for each layer.
-Animation support could be added in the future if needed.
+    Layers are kept in a flat array, and are drawn in order of their IDs.
+    A layer handle can be used instead of the layer ID, which avoids looking up the ID on every call.
+    Layers can be sparse, which means only tiles with a non-zero ID are stored and drawn.
+    This saves memory and drawing time on mostly empty layers (decorations, overlays, etc.)
+    Normal layers can store their IDs in 1 or 2 bytes instead of 4, when there are few enough types.
+Tile types can have property flags (solid, water, etc.), which are defined by the game.
+    Each layer keeps a bitset of the tiles with each property, in both row-major and column-major order.
+    The area, raycast, and column queries scan these bitsets instead of looking at each tile ID.
+When zoomed out far enough that tiles get smaller than a few pixels, blocks of tiles are drawn as single quads.
+    Each level of detail merges 2x2 quads of the previous level, showing the most common tile of the block.
+    The merged quads of a chunk are built when it is first drawn at that level, and rebuilt after its tiles change.
+    When too many chunks are visible, or a whole chunk is smaller than a few pixels, each layer is drawn from an overview
+    instead, which merges the quads of every chunk into a vertex array per tileset (and whole chunks at the higher levels).
+    An overview has at most 256x256 blocks, so the vertices and draw calls have a fixed cap at any zoom level.
+A minimap image with a pixel per tile can be kept, showing the average color of the top tile of each cell.
+    The average colors are calculated from the tilesets when they are loaded.
+    Only the pixels of changed tiles are recolored, and only the chunks with changed pixels are uploaded.
+Tile IDs can be animated, so that every tile with that ID cycles through a list of frames.
+    Each animation keeps an index of its tiles, so update() only rewrites their quads.
 */
 class TileMap: public sf::Drawable, public sf::Transformable
 {
     public:
+        // A handle to a layer, which stays valid until loadFromFile() replaces all of the layers
+        struct LayerHandle
+        {
+            unsigned index;
+        };
+
         TileMap();
 
         bool loadFromConfig(const std::string& filename);
 
-        // Loads a texture to use for the tile set
+        // Loads the tileset parameters and all of the layers from a binary map file
+        // The file is memory mapped, and the vertices are built straight from the mapped IDs
+        bool loadFromFile(const std::string& filename);
+
+        // Saves the tileset parameters and all of the layers to a binary map file
+        bool saveToFile(const std::string& filename) const;
+
+        // Loads a texture to use for the tile set (removes any other tilesets)
         bool loadTileset(const std::string& filename, unsigned tileWidth, unsigned tileHeight, unsigned types = 0, unsigned padding = 0);
 
+        // Adds another tileset, whose IDs start at the current total number of types
+        // The tiles are drawn at the tile size of the map
+        bool addTileset(const std::string& filename, unsigned tileWidth, unsigned tileHeight, unsigned types = 0, unsigned padding = 0);
+
+        // Returns the number of tilesets, and the first ID of a tileset
+        unsigned getTilesetCount() const;
+        unsigned getFirstId(unsigned tileset) const;
+
         // Resizes all of the layers to the same size
+        // The vertices of large layers are built in parallel on the engine's thread pool
         void resize(unsigned width, unsigned height);
 
+        // Resizes on the thread pool, so the calling thread can do other work while large layers are rebuilt
+        // The tile map must not be used until the future is ready
+        std::future<void> resizeAsync(unsigned width, unsigned height);
+
         // Sets the "current" layer (so the layer doesn't have to always be specified)
         void useLayer(int layer);
+        void useLayer(LayerHandle layer);
+
+        // Returns the handle of a layer (creates the layer if it doesn't exist)
+        LayerHandle getLayer(int layer);
 
-        // Sets a tile to a certain "visual" ID
+        // Creates a layer and makes it the current layer (layers are also created when first used)
+        // Setting a tile of a sparse layer to 0 removes it, and unset tiles are 0
+        // Normal layers store each ID in idSize bytes (1, 2, or 4), which must fit all of the types
+        //     Layers are widened when tilesets are added, and IDs past the last type are rejected with an error
+        LayerHandle createLayer(int layer, bool sparse = false, unsigned idSize = 4);
+
+        // Returns the number of bytes used to store each ID of a layer (0 if the layer doesn't exist)
+        unsigned getIdSize(int layer) const;
+
+        // Sets a tile to a certain "visual" ID (IDs other than 0 must be less than getTotalTypes())
         void set(int layer, unsigned x, unsigned y, unsigned value);
+        void set(LayerHandle layer, unsigned x, unsigned y, unsigned value);
         void set(unsigned x, unsigned y, unsigned value);
 
+        // Sets many tiles at once, which is much faster than calling set() for each tile
+        // Regions are clipped to the bounds of the map
+        // Sets a region of tiles from a row-major array of width * height IDs
+        void setRegion(int layer, unsigned x, unsigned y, unsigned width, unsigned height, const unsigned* values);
+        // Sets a horizontal run of tiles starting at (x, y) from an array of count IDs
+        void setRow(int layer, unsigned x, unsigned y, const unsigned* values, unsigned count);
+        // Sets every tile in a layer (or in a region of a layer) to the same ID
+        void fill(int layer, unsigned value);
+        void fill(int layer, unsigned x, unsigned y, unsigned width, unsigned height, unsigned value);
+
         // Returns the visual ID of a tile
         unsigned operator()(int layer, unsigned x, unsigned y) const;
+        unsigned operator()(LayerHandle layer, unsigned x, unsigned y) const;
         unsigned operator()(unsigned x, unsigned y) const;
 
         // The size of the tile map in pixels (3840x2160 for example)
@@ -73,35 +153,310 @@ class TileMap: public sf::Drawable, public sf::Transformable
         // Applies a color to all vertices
         void setColor(const sf::Color& color);
 
-        // Returns total number of unique visual IDs
+        // Applies a color to the vertices of a single tile (tiles added to sparse layers later get the color from setColor())
+        void setTileColor(LayerHandle layer, unsigned x, unsigned y, const sf::Color& color);
+
+        // Starts or stops keeping the minimap image up to date
+        void setMinimapEnabled(bool enabled);
+
+        // Returns the minimap texture, after uploading the areas that changed since the last call
+        const sf::Texture& getMinimap();
+        const sf::Image& getMinimapImage() const;
+
+        // Returns the average color of a tile type (transparent for unknown types)
+        const sf::Color& getAverageColor(unsigned value) const;
+
+        // Returns total number of unique visual IDs (of all of the tilesets)
         unsigned getTotalTypes() const;
 
-        // Draws a single layer of the tile map
+        // Sets the property flags of a tile type (each bit is a property, like solid or water)
+        // This rebuilds the bitsets of every layer, so it is best to set the properties before the tiles
+        void setProperties(unsigned value, std::uint32_t properties);
+        std::uint32_t getProperties(unsigned value) const;
+
+        // Returns true if a tile has any of the properties
+        bool hasProperties(LayerHandle layer, unsigned x, unsigned y, std::uint32_t properties) const;
+
+        // Returns true if any tile overlapping a rectangle (in local pixel coordinates) has any of the properties
+        bool overlaps(LayerHandle layer, const sf::FloatRect& rect, std::uint32_t properties) const;
+
+        // Walks through the tiles along a line (in local pixel coordinates) in order
+        // Returns true if one of them has any of the properties, and stores its position in hit
+        bool raycast(LayerHandle layer, const sf::Vector2f& start, const sf::Vector2f& end, std::uint32_t properties, sf::Vector2u* hit = nullptr) const;
+
+        // Returns the row of the first tile in a column, starting at startY and going down, with any of the properties
+        // Returns the map height if there are none
+        unsigned findInColumn(LayerHandle layer, unsigned x, unsigned startY, std::uint32_t properties) const;
+
+        // Animates every tile with a certain ID, by cycling through a list of IDs to display
+        // Animating ID 0 includes the tiles of normal layers that were never set, even in layers created later
+        void addAnimation(unsigned value, const std::vector<unsigned>& frames, float frameDuration);
+
+        // Advances the animations, which only updates the tiles that are animated
+        void update(float dt);
+
+        // Draws a single layer of the tile map (only the chunks in the target's view)
         void drawLayer(sf::RenderTarget& target, int layer);
+        void drawLayer(sf::RenderTarget& target, LayerHandle layer);
 
-        // Draws all of the layers of the tile map in order
+        // Draws all of the layers of the tile map in order (only the chunks in the target's view)
         virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
 
+        // Returns the number of draw calls made by the last call to draw() or drawLayer()
+        unsigned getDrawCalls() const;
+
+        // Sets the smallest size in screen pixels that tiles are drawn at before they are merged (0 disables merging)
+        void setLodThreshold(float pixels);
+
+        // Returns the level of detail used by the last call to draw() or drawLayer()
+        // Level 0 draws every tile, and each level after that merges 2x2 blocks of the previous level
+        // Levels above maxLodLevel merge 2x2 blocks of chunks, and are only drawn from the overview of each layer
+        unsigned getLodLevel() const;
+
+        // The width and height of a chunk in tiles
+        static const unsigned chunkSize = 32;
+
+        // The coarsest level of detail that is built per chunk, which is a single quad per chunk
+        static const unsigned maxLodLevel = 5;
+
+    protected:
+        // Fixes the tile size, so loading tilesets or maps with a different tile size fails (used by FixedTileMap)
+        TileMap(unsigned fixedWidth, unsigned fixedHeight);
+
     private:
+        // The IDs of a normal layer, packed into 1, 2, or 4 bytes each
+        class TileIds
+        {
+            public:
+                TileIds();
+                void resize(unsigned count);
+                void clear();
+                unsigned size() const;
+                unsigned get(unsigned index) const;
+                void set(unsigned index, unsigned value); // The value must fit
+                bool fits(unsigned value) const;
+
+                // Changes the number of bytes per ID, converting the existing IDs
+                void setIdSize(unsigned bytes);
+                unsigned getIdSize() const;
+
+            private:
+                std::vector<std::uint8_t> data;
+                unsigned idSize;
+                unsigned maxValue;
+        };
+
+        // The quads of a chunk which use the same tileset
+        // In normal layers, there is a quad for every tile, and tiles from other tilesets are hidden
+        // In sparse layers, there are only quads for the tiles that are set
+        struct TileBatch
+        {
+            unsigned tileset;
+            sf::VertexArray vertices;
+            std::vector<unsigned> cells; // Sparse layers only: quad position -> tile index
+            std::vector<unsigned> values; // Sparse layers only: quad position -> tile ID
+        };
+
+        struct TileSlot
+        {
+            unsigned batch;
+            unsigned quad;
+        };
+
+        struct TileChunk
+        {
+            std::vector<TileBatch> batches;
+            std::unordered_map<unsigned, TileSlot> slots; // Sparse layers only: tile index -> quad
+            mutable std::vector<std::vector<TileBatch>> lods; // Merged quads of each level of detail
+            mutable unsigned lodBuilt; // Bit per level of detail that is up to date
+            TileChunk(): lodBuilt(0) {}
+        };
+
         struct TileLayer
         {
-            sf::VertexArray vertices; // Graphical tiles
-            std::vector<unsigned> tiles; // Tile IDs
+            TileIds tiles; // Tile IDs (empty for sparse layers)
+            std::vector<TileChunk> chunks; // Row-major, chunkCount.x by chunkCount.y
+            std::unordered_map<unsigned, unsigned> animated; // Tile index -> position in its animation
+            std::vector<BitMatrix> propertyRows; // Property bit -> tiles with that property
+            std::vector<BitMatrix> propertyColumns; // The same bits, transposed for scanning columns
+            mutable std::vector<TileBatch> overview; // The merged quads of all of the chunks
+            mutable unsigned overviewLevel; // The level of detail of the overview (0 if it is out of date)
+            sf::Vector2u size; // The map size this layer was set up for
+            int id;
+            bool sparse;
+            TileLayer(): overviewLevel(0), id(0), sparse(false) {}
         };
 
-        void resize();
+        struct AnimatedTile
+        {
+            unsigned layer; // Index in layers
+            unsigned x;
+            unsigned y;
+        };
+
+        struct TileAnimation
+        {
+            std::vector<unsigned> frames; // IDs to display
+            float frameDuration;
+            float elapsed;
+            unsigned currentFrame;
+            std::vector<AnimatedTile> tiles; // All of the tiles using this animation
+        };
+
+        // Adds a new layer, and inserts it into the draw order
+        unsigned addLayer(int layer, bool sparse, unsigned idSize);
+
         void resize(TileLayer& layer);
         void applyColor();
 
+        // Sizes the property bitsets of a layer, and sets them to the properties of ID 0
+        void resetProperties(TileLayer& layer);
+
+        // Sets the property bits of the tiles in a region from their IDs
+        void buildProperties(TileLayer& layer, unsigned x, unsigned y, unsigned endX, unsigned endY);
+
+        // Updates the property bits of a tile when its ID changes
+        void updateProperties(TileLayer& layer, unsigned x, unsigned y, unsigned oldValue, unsigned value);
+
+        // Returns the ID of a tile (the coordinates must be in bounds)
+        unsigned getTile(const TileLayer& layer, unsigned x, unsigned y) const;
+
+        // Sets a tile of the current layer when it is sparse, adding or removing its quad
+        void setSparse(unsigned x, unsigned y, unsigned value);
+
+        // Returns a valid ID size that fits all of the types (prints an error if the requested size doesn't)
+        unsigned validateIdSize(unsigned idSize) const;
+
+        // Returns true if a tile size can be loaded (prints an error if it doesn't match the fixed tile size)
+        bool checkTileSize(unsigned tileWidth, unsigned tileHeight, const std::string& filename) const;
+
+        // Returns true if an ID can be set (prints an error if it is past the last type)
+        bool validateId(unsigned value) const;
+
+        // Returns the smallest ID size (in bytes) that can store an ID
+        static unsigned getIdBytes(unsigned value);
+
+        // Sets the positions of a quad to cover a tile
+        void setPositions(sf::Vertex* quad, unsigned x, unsigned y) const;
+
+        // Collapses a quad so it isn't visible
+        void hideQuad(sf::Vertex* quad) const;
+
+        // Returns the index of the tileset that an ID belongs to
+        unsigned getTileset(unsigned value) const;
+
+        // Copies the texture coordinates of a tile type into a quad
+        void setTexCoords(sf::Vertex* quad, unsigned value) const;
+
+        // Updates the quad of a tile that is displaying a different ID, moving it to another batch if needed
+        // The tile must have a quad (sparse layers only have quads for non-zero tiles)
+        void displayTile(TileLayer& layer, unsigned x, unsigned y, unsigned oldDisplay, unsigned display);
+
+        // Returns the ID to display for a tile, which is the current frame if it is animated
+        unsigned getFrame(unsigned value) const;
+
+        // Updates the quads of all of the tiles using an animation to its current frame
+        void applyAnimation(const TileAnimation& anim, unsigned oldDisplay);
+
+        // Returns the animation of an ID, or nullptr if it isn't animated
+        TileAnimation* findAnimation(unsigned value);
+
+        // Moves a tile of the current layer between animation indexes when its ID changes
+        void updateAnimated(unsigned x, unsigned y, unsigned oldValue, unsigned value);
+
+        // Removes all of the tiles of a layer from the animation indexes
+        void removeAnimated(unsigned layer);
+
+        // Adds the tiles of a new or reset normal layer to the animation of ID 0, since they never go through set()
+        void animateDefaultTiles(unsigned layer);
+
+        // Sets the rows [y, endY) of the current layer from x to endX, in parallel when it is safe
+        // The values of each row start pitch values after the previous row (ignored if repeat is true)
+        void setRows(unsigned x, unsigned y, unsigned endX, unsigned endY, const unsigned* values, unsigned pitch, bool repeat);
+
+        // Sets a horizontal run of tiles of the current layer in one linear pass (the run must be in bounds)
+        // If repeat is true, only the first value is used for the whole run
+        void setRun(unsigned x, unsigned y, unsigned count, const unsigned* values, bool repeat);
+
+        // Returns the chunk containing a tile (the coordinates must be in bounds)
+        TileChunk& getChunk(TileLayer& layer, unsigned x, unsigned y);
+
+        // Returns the number of tiles in a chunk (edge chunks can be smaller)
+        unsigned getChunkTiles(unsigned chunkX, unsigned chunkY) const;
+
+        // Returns the index of a tile within its chunk (normal layers only)
+        unsigned getChunkIndex(unsigned x, unsigned y) const;
+
+        // Returns the batch of a chunk for a tileset, adding it if needed
+        TileBatch& getBatch(TileLayer& layer, unsigned x, unsigned y, unsigned tileset);
+
+        // Returns the batch index of a tileset in a chunk, or the batch count if it has none
+        unsigned findBatch(const TileChunk& chunk, unsigned tileset) const;
+
+        // Adds and removes the quads of sparse layers (the tile must be in the chunk)
+        void addSparseQuad(TileChunk& chunk, unsigned x, unsigned y, unsigned value, unsigned display, const sf::Color& color);
+        void removeSparseQuad(TileChunk& chunk, unsigned index);
+
+        // Returns the first vertex of a tile's quad (the coordinates must be in bounds)
+        // Returns nullptr for tiles that are not set in sparse layers
+        sf::Vertex* getQuad(TileLayer& layer, unsigned x, unsigned y);
+
+        // Returns the first vertex of a tile's quad, or nullptr if the tile has none
+        const sf::Vertex* findQuad(const TileLayer& layer, unsigned x, unsigned y) const;
+
+        // Marks the merged quads of the chunks overlapping the tiles [x, endX) by [y, endY) as out of date
+        void invalidateLod(TileLayer& layer, unsigned x, unsigned y, unsigned endX, unsigned endY);
+
+        // Returns the level of detail to draw at, from how large a tile is on the target
+        unsigned chooseLodLevel(const sf::RenderTarget& target, const sf::FloatRect& viewRect) const;
+
+        // Builds the merged quads of a chunk for a level of detail
+        void buildLod(const TileLayer& layer, unsigned chunkIndex, unsigned level) const;
+
+        // Returns the lowest level of detail that keeps an overview within its maximum number of blocks
+        unsigned getOverviewLevel() const;
+
+        // Builds the overview of a layer for a level of detail
+        void buildOverview(const TileLayer& layer, unsigned level) const;
+
+        // Recolors the minimap pixels of the tiles [x, endX) by [y, endY), and marks their chunks to be uploaded
+        // The whole minimap is recolored if the map size changed
+        void updateMinimap(unsigned x, unsigned y, unsigned endX, unsigned endY);
+
+        // Returns the minimap color of a cell, which is the average color of its top visible tile
+        sf::Color getMinimapColor(unsigned x, unsigned y) const;
+
+        // Draws the chunks of a layer that intersect the target's view
+        void drawChunks(const TileLayer& layer, sf::RenderTarget& target, const sf::RenderStates& states) const;
+
+        // Draws each batch of a list with the texture of its tileset
+        void drawBatches(const std::vector<TileBatch>& batches, sf::RenderTarget& target, const sf::RenderStates& states) const;
+
         unsigned totalTiles; // Total # of tiles in 1 layer
-        unsigned totalTypes; // Unique visual IDs
-        unsigned tilePadding; // Amount of padding in pixels
         sf::Vector2u mapSize; // In # of tiles
         sf::Vector2u tileSize; // In pixels
-        sf::Texture texture; // The tile set
-        std::map<int, TileLayer> tiles;
+        sf::Vector2u fixedTileSize; // In pixels, or 0x0 if the tile size can change
+        sf::Vector2u chunkCount; // In # of chunks
+        std::deque<Tileset> tilesets;
+        std::vector<unsigned> firstIds; // The first ID of each tileset
+        std::vector<unsigned> tilesetIds; // Tile ID -> index in tilesets
+        std::deque<TileLayer> layers; // Never shrinks, so handles and pointers stay valid
+        std::map<int, unsigned> layerIds; // Layer ID -> index in layers
+        std::vector<unsigned> drawOrder; // Indexes in layers, sorted by layer ID
         TileLayer* currentLayer; // Points to the last layer used
+        unsigned currentLayerIndex; // Index of the last layer used
+        std::vector<TileAnimation> animations;
+        std::vector<unsigned> animationIds; // Tile ID -> index in animations
+        std::vector<std::uint32_t> typeProperties; // Tile ID -> property flags
+        std::uint32_t usedProperties; // All of the property flags that any type has had
         sf::Color vertexColor; // Color applied to all vertices
+        mutable unsigned drawCalls; // Draw calls made by the last draw
+        float lodThreshold; // In screen pixels
+        bool minimapEnabled;
+        sf::Image minimapImage; // A pixel per tile
+        sf::Texture minimapTexture;
+        std::vector<bool> minimapDirty; // Chunks with pixels that haven't been uploaded
+        mutable unsigned lodLevel; // Level of detail used by the last draw
 };
 
 template <typename T>
@@ -0,0 +1,57 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef TILESET_H
+#define TILESET_H
+
+#include <string>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+namespace ng
+{
+
+/*
+This class handles a texture of tiles, which are all the same size.
+The texture coordinates of every tile type are calculated once when the texture is loaded,
+    so looking up a tile's coordinates is just a table lookup.
+The average color of every tile type is also calculated when loading, for drawing minimaps.
+The tables are never modified after loading, so they can be read from multiple threads.
+*/
+class Tileset
+{
+    public:
+        Tileset();
+
+        // Loads the texture, and calculates the total types from its size if types is 0
+        bool loadFromFile(const std::string& filename, unsigned tileWidth, unsigned tileHeight, unsigned types = 0, unsigned padding = 0);
+
+        // Copies the texture coordinates of a tile type into a quad
+        // Unknown types are left with the texture coordinates they had before
+        void setTexCoords(sf::Vertex* quad, unsigned value) const;
+
+        // Returns the average color of the pixels of a tile type (transparent for unknown types)
+        const sf::Color& getAverageColor(unsigned value) const;
+
+        const sf::Texture& getTexture() const;
+        const std::string& getFilename() const;
+        const sf::Vector2u& getTileSize() const;
+        unsigned getTotalTypes() const;
+        unsigned getPadding() const;
+
+    private:
+        void buildTexCoords();
+        void buildAverageColors(const sf::Image& image);
+
+        sf::Texture texture;
+        std::string filename;
+        sf::Vector2u tileSize; // In pixels
+        unsigned totalTypes; // Unique visual IDs
+        unsigned padding; // Amount of padding in pixels
+        std::vector<sf::Vector2f> texCoords; // 4 texture coordinates per tile type
+        std::vector<sf::Color> averageColors; // Average color per tile type
+};
+
+}
+
+#endif
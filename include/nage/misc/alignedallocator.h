@@ -0,0 +1,75 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef ALIGNEDALLOCATOR_H
+#define ALIGNEDALLOCATOR_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+namespace ng
+{
+
+/*
+This class is an allocator for standard containers, which aligns memory to a power of two.
+The default of 32 bytes lets SSE and AVX use aligned loads and stores on the whole buffer.
+The extra memory is allocated in front of the block, and the original pointer is stored right before the aligned address.
+
+Example:
+    std::vector<float, AlignedAllocator<float>> values(1024);
+*/
+template <class Type, std::size_t Alignment = 32>
+class AlignedAllocator
+{
+    static_assert(Alignment >= sizeof(void*) && !(Alignment & (Alignment - 1)), "The alignment must be a power of two of at least the size of a pointer");
+
+    public:
+        using value_type = Type;
+
+        template <class Other>
+        struct rebind
+        {
+            using other = AlignedAllocator<Other, Alignment>;
+        };
+
+        AlignedAllocator() noexcept {}
+
+        template <class Other>
+        AlignedAllocator(const AlignedAllocator<Other, Alignment>&) noexcept {}
+
+        Type* allocate(std::size_t count)
+        {
+            if (count > (static_cast<std::size_t>(-1) - Alignment) / sizeof(Type))
+                throw std::bad_alloc();
+            void* block = std::malloc(count * sizeof(Type) + Alignment);
+            if (!block)
+                throw std::bad_alloc();
+            // There is always at least one pointer of space before the aligned address
+            std::uintptr_t address = (reinterpret_cast<std::uintptr_t>(block) + Alignment) & ~static_cast<std::uintptr_t>(Alignment - 1);
+            reinterpret_cast<void**>(address)[-1] = block;
+            return reinterpret_cast<Type*>(address);
+        }
+
+        void deallocate(Type* pointer, std::size_t) noexcept
+        {
+            if (pointer)
+                std::free(reinterpret_cast<void**>(pointer)[-1]);
+        }
+};
+
+template <class Type1, class Type2, std::size_t Alignment>
+bool operator==(const AlignedAllocator<Type1, Alignment>&, const AlignedAllocator<Type2, Alignment>&) noexcept
+{
+    return true;
+}
+
+template <class Type1, class Type2, std::size_t Alignment>
+bool operator!=(const AlignedAllocator<Type1, Alignment>&, const AlignedAllocator<Type2, Alignment>&) noexcept
+{
+    return false;
+}
+
+}
+
+#endif
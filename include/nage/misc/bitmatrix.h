@@ -0,0 +1,63 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef BITMATRIX_H
+#define BITMATRIX_H
+
+#include <vector>
+#include <cstdint>
+
+namespace ng
+{
+
+/*
+This class is a 2D array of bits, packed into 64-bit words.
+Each row starts on a new word, so rows can be scanned a word at a time.
+    any() and findInRow() test up to 64 bits per step, which makes area and line queries fast.
+Note that positions are (x, y), which is (column, row), like Matrix.
+*/
+class BitMatrix
+{
+    public:
+        BitMatrix();
+        BitMatrix(unsigned width, unsigned height);
+
+        // Resizes the matrix, which clears all of the bits
+        void resize(unsigned width, unsigned height);
+
+        // Removes all of the bits, so the size is 0x0
+        void clear();
+
+        // Sets or clears all of the bits
+        void fill(bool value);
+
+        void set(unsigned x, unsigned y, bool value);
+        bool get(unsigned x, unsigned y) const;
+
+        // Combines the bits of another matrix of the same size a word at a time
+        // merge() sets the bits that are set in either matrix, and toggle() sets the bits that are different
+        void merge(const BitMatrix& other);
+        void toggle(const BitMatrix& other);
+
+        // Returns true if any bit is set in the columns [x, endX) of the rows [y, endY)
+        bool any(unsigned x, unsigned y, unsigned endX, unsigned endY) const;
+
+        // Returns the column of the first set bit in [x, endX) of a row, or endX if there are none
+        unsigned findInRow(unsigned y, unsigned x, unsigned endX) const;
+
+        unsigned width() const;
+        unsigned height() const;
+
+    private:
+        // Returns a mask of the bits [begin, end) of a word (end can be 64)
+        static std::uint64_t getMask(unsigned begin, unsigned end);
+
+        std::vector<std::uint64_t> words;
+        unsigned matrixWidth;
+        unsigned matrixHeight;
+        unsigned rowWords; // Words per row
+};
+
+}
+
+#endif
@@ -0,0 +1,262 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef CHUNKEDGRID_H
+#define CHUNKEDGRID_H
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+#include "nage/misc/matrixview.h"
+
+namespace ng
+{
+
+/*
+This class is an unbounded 2D grid, which can be used instead of a Matrix for infinite worlds.
+The grid is split into square chunks, which are only allocated when something is set in them.
+    Positions can be negative, and the grid never needs to be resized, so nothing is ever copied when it grows.
+    Elements in chunks that don't exist have the default value.
+    releaseEmptyChunks() frees the chunks that only have default values, so memory only depends on the used area.
+The last chunk that was accessed is cached, since most accesses are near the previous one.
+    Because of that, even the const functions aren't safe to call from multiple threads at once.
+forEachChunk() gives a MatrixView of each chunk, so bulk work doesn't need to look up every element.
+
+Example:
+    ChunkedGrid<std::uint8_t> explored;
+    explored.set(-500, 1200, 1);
+    explored.fillRect(-10, -10, 20, 20, 1);
+    explored.forEachChunk([](int chunkX, int chunkY, MatrixView<std::uint8_t> chunk)
+    {
+        chunk.transform(fade);
+    });
+    explored.releaseEmptyChunks();
+*/
+template <class Type, unsigned ChunkSize = 32>
+class ChunkedGrid
+{
+    static_assert(ChunkSize && !(ChunkSize & (ChunkSize - 1)), "The chunk size must be a power of two");
+
+    // Returns the base 2 logarithm of a power of two
+    static constexpr unsigned log2(unsigned value)
+    {
+        return (value > 1 ? 1 + log2(value >> 1) : 0);
+    }
+
+    public:
+        static const unsigned chunkSize = ChunkSize;
+
+        explicit ChunkedGrid(const Type& defaultValue = Type()):
+            defaultValue(defaultValue),
+            cachedKey(0),
+            cachedChunk(nullptr)
+        {
+        }
+
+        // Copying a grid would make its cache point to the other grid's chunks, and copying every chunk is rarely wanted
+        ChunkedGrid(const ChunkedGrid&) = delete;
+        ChunkedGrid& operator=(const ChunkedGrid&) = delete;
+
+        // Returns an element, which is the default value if its chunk isn't allocated
+        const Type& get(int x, int y) const
+        {
+            Chunk* chunk = findChunk(getChunkPosition(x), getChunkPosition(y));
+            return (chunk ? chunk->elements[getIndex(x, y)] : defaultValue);
+        }
+
+        // Sets an element, which allocates its chunk unless the value is the default
+        void set(int x, int y, const Type& value)
+        {
+            Chunk* chunk = findChunk(getChunkPosition(x), getChunkPosition(y));
+            if (chunk)
+                chunk->elements[getIndex(x, y)] = value;
+            else if (!(value == defaultValue))
+                getChunk(getChunkPosition(x), getChunkPosition(y)).elements[getIndex(x, y)] = value;
+        }
+
+        // Returns an element that can be changed, which always allocates its chunk
+        Type& operator()(int x, int y)
+        {
+            return getChunk(getChunkPosition(x), getChunkPosition(y)).elements[getIndex(x, y)];
+        }
+
+        // Sets the elements in a rectangle to a value, a chunk at a time
+        void fillRect(int x, int y, unsigned width, unsigned height, const Type& value)
+        {
+            if (!width || !height)
+                return;
+            // The end positions are inclusive, so the rectangle can reach the largest int
+            int endX = static_cast<int>(std::min<long long>(x + static_cast<long long>(width) - 1, INT_MAX));
+            int endY = static_cast<int>(std::min<long long>(y + static_cast<long long>(height) - 1, INT_MAX));
+            bool isDefault = (value == defaultValue);
+            for (int chunkY = getChunkPosition(y); chunkY <= getChunkPosition(endY); ++chunkY)
+            {
+                for (int chunkX = getChunkPosition(x); chunkX <= getChunkPosition(endX); ++chunkX)
+                {
+                    Chunk* chunk = findChunk(chunkX, chunkY);
+                    if (!chunk && isDefault)
+                        continue;
+                    if (!chunk)
+                        chunk = &getChunk(chunkX, chunkY);
+                    // Clip the rectangle to the chunk
+                    unsigned left = (chunkX == getChunkPosition(x) ? getLocal(x) : 0);
+                    unsigned top = (chunkY == getChunkPosition(y) ? getLocal(y) : 0);
+                    unsigned right = (chunkX == getChunkPosition(endX) ? getLocal(endX) + 1 : ChunkSize);
+                    unsigned bottom = (chunkY == getChunkPosition(endY) ? getLocal(endY) + 1 : ChunkSize);
+                    getView(*chunk).getSubview(left, top, right - left, bottom - top).fill(value);
+                }
+            }
+        }
+
+        // Returns true if the chunk at chunk coordinates is allocated
+        bool hasChunk(int chunkX, int chunkY) const
+        {
+            return (findChunk(chunkX, chunkY) != nullptr);
+        }
+
+        // Calls function(chunkX, chunkY, view) for each allocated chunk, in no particular order
+        // The top left element of a chunk is at (chunkX * chunkSize, chunkY * chunkSize)
+        template <class Function>
+        void forEachChunk(Function function)
+        {
+            for (auto& chunk: chunks)
+                function(getChunkX(chunk.first), getChunkY(chunk.first), getView(*chunk.second));
+        }
+
+        template <class Function>
+        void forEachChunk(Function function) const
+        {
+            for (auto& chunk: chunks)
+                function(getChunkX(chunk.first), getChunkY(chunk.first), MatrixView<const Type>(getView(*chunk.second)));
+        }
+
+        // Frees the chunks that only have default values, and returns how many were freed
+        unsigned releaseEmptyChunks()
+        {
+            unsigned released = 0;
+            for (auto it = chunks.begin(); it != chunks.end(); )
+            {
+                const auto& elements = it->second->elements;
+                if (std::all_of(elements.begin(), elements.end(), [&](const Type& element){ return element == defaultValue; }))
+                {
+                    it = chunks.erase(it);
+                    ++released;
+                }
+                else
+                    ++it;
+            }
+            if (released)
+                cachedChunk = nullptr;
+            return released;
+        }
+
+        // Frees all of the chunks
+        void clear()
+        {
+            chunks.clear();
+            cachedChunk = nullptr;
+        }
+
+        std::size_t getChunkCount() const
+        {
+            return chunks.size();
+        }
+
+        // Returns the bytes used by the chunks (not including the hash table)
+        std::size_t getMemoryUsage() const
+        {
+            return chunks.size() * sizeof(Chunk);
+        }
+
+        const Type& getDefaultValue() const
+        {
+            return defaultValue;
+        }
+
+        // Returns the chunk coordinate that contains a position, which rounds down for negative positions
+        static int getChunkPosition(int position)
+        {
+            return (position >= 0 ? position >> shift : ~(~position >> shift));
+        }
+
+    private:
+        static const unsigned shift = log2(ChunkSize);
+
+        struct Chunk
+        {
+            std::array<Type, ChunkSize * ChunkSize> elements;
+        };
+
+        // Returns a position relative to the chunk that contains it
+        static unsigned getLocal(int position)
+        {
+            return static_cast<unsigned>(position) & (ChunkSize - 1);
+        }
+
+        static unsigned getIndex(int x, int y)
+        {
+            return (getLocal(y) << shift) + getLocal(x);
+        }
+
+        static std::uint64_t getKey(int chunkX, int chunkY)
+        {
+            return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(chunkX)) << 32) | static_cast<std::uint32_t>(chunkY);
+        }
+
+        static int getChunkX(std::uint64_t key)
+        {
+            return static_cast<std::int32_t>(static_cast<std::uint32_t>(key >> 32));
+        }
+
+        static int getChunkY(std::uint64_t key)
+        {
+            return static_cast<std::int32_t>(static_cast<std::uint32_t>(key));
+        }
+
+        static MatrixView<Type> getView(Chunk& chunk)
+        {
+            return MatrixView<Type>(chunk.elements.data(), ChunkSize, ChunkSize, ChunkSize);
+        }
+
+        // Returns a chunk if it is allocated, checking the last chunk that was found first
+        Chunk* findChunk(int chunkX, int chunkY) const
+        {
+            std::uint64_t key = getKey(chunkX, chunkY);
+            if (cachedChunk && cachedKey == key)
+                return cachedChunk;
+            auto found = chunks.find(key);
+            if (found == chunks.end())
+                return nullptr;
+            cachedKey = key;
+            cachedChunk = found->second.get();
+            return cachedChunk;
+        }
+
+        // Returns a chunk, which is allocated and filled with the default value if it doesn't exist
+        Chunk& getChunk(int chunkX, int chunkY)
+        {
+            Chunk* chunk = findChunk(chunkX, chunkY);
+            if (!chunk)
+            {
+                std::unique_ptr<Chunk>& newChunk = chunks[getKey(chunkX, chunkY)];
+                newChunk.reset(new Chunk);
+                newChunk->elements.fill(defaultValue);
+                chunk = newChunk.get();
+                cachedKey = getKey(chunkX, chunkY);
+                cachedChunk = chunk;
+            }
+            return *chunk;
+        }
+
+        std::unordered_map<std::uint64_t, std::unique_ptr<Chunk>> chunks;
+        Type defaultValue;
+        mutable std::uint64_t cachedKey;
+        mutable Chunk* cachedChunk;
+};
+
+}
+
+#endif
@@ -5,6 +5,17 @@
 #define MATRIX_H
 
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <iterator>
+#include <cstddef>
+#include "nage/misc/alignedallocator.h"
+#include "nage/misc/matrixlayouts.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NG_MATRIX_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace ng
 {
@@ -12,14 +23,31 @@ namespace ng
 /*
 This class lets you easily create resizable 2D arrays.
 It uses a single vector, which is more efficient than having a vector of vectors, because memory is only allocated once.
-    Resizing is still not very efficient, so don't use this if you need to do that a lot.
 The size can be changed dynamically on runtime in a non-destructive way.
-    Note: All of the elements are copied into a new matrix, so try not to do this often.
+    Like a vector, there is extra capacity in both dimensions, so with the row major layout each row starts pitch() elements after the previous one.
+    Resizing within the capacity doesn't allocate. Otherwise the capacity grows by 1.5x in the dimension that ran out,
+        and the elements are moved (or memcpy'd for simple types) into the new memory.
+    The first resize, reserve() and shrinkToFit() use exact sizes, so fixed size matrices don't waste any memory.
+The elements are aligned to 32 bytes, and the bulk functions (fill, fillRect, copyRect, transform, count, compare)
+    work on ranges of elements that are next to each other in memory (whole rows with the row major layout),
+    so they use memset/memcpy for simple types and can be vectorized.
+    count() uses SSE2 directly for 8 and 32-bit integers, since compilers don't always vectorize reductions.
+The layout decides the order of the elements in memory (see matrixlayouts.h), and defaults to row major.
+    All of the functions work the same with every layout, and the bulk functions work on the ranges that are contiguous.
+    The iterators walk through the elements in storage order, which is the fastest order when the position doesn't matter.
+
+Example:
+    Matrix<unsigned> costs(256, 256);
+    costs.fill(1);
+    costs.fillRect(10, 10, 20, 5, 0);
+    unsigned blocked = costs.count(0);
 */
-template <class Type>
+template <class Type, class Layout = RowMajorLayout>
 class Matrix
 {
     public:
+        using MatrixType = std::vector<Type, AlignedAllocator<Type>>;
+
         Matrix()
         {
             clear();
@@ -27,31 +55,56 @@ class Matrix
 
         Matrix(unsigned width, unsigned height)
         {
+            clear();
             resize(width, height);
         }
 
+        // Changes the size, the new elements are default constructed
+        // If preserve is false, all of the elements are reset instead of being kept
         void resize(unsigned width, unsigned height, bool preserve = true)
         {
             // Only resize if the new size is different
-            if (matrixWidth != width || matrixHeight != height)
+            if (matrixWidth == width && matrixHeight == height)
+                return;
+            unsigned capacityWidth = layout.getCapacityWidth();
+            unsigned capacityHeight = layout.getCapacityHeight();
+            if (width <= capacityWidth && height <= capacityHeight)
             {
-                unsigned newMatrixSize = width * height;
-                if (!elements.empty() && preserve)
+                // Reset the elements outside of the new size, so the unused capacity is always default constructed
+                if (preserve)
                 {
-                    // Preserve the original data by copying it
-                    std::vector<Type> tempElements(newMatrixSize);
-                    copyMatrix(elements, tempElements, matrixWidth, width, matrixHeight, height);
-                    elements.swap(tempElements);
+                    resetRect(width, 0, matrixWidth, std::min(height, matrixHeight));
+                    resetRect(0, height, matrixWidth, matrixHeight);
                 }
                 else
-                {
-                    elements.clear();
-                    elements.resize(newMatrixSize);
-                }
-                matrixWidth = width;
-                matrixHeight = height;
-                matrixSize = newMatrixSize;
+                    resetRect(0, 0, matrixWidth, matrixHeight);
             }
+            else
+            {
+                // Only the dimension that ran out of capacity grows
+                unsigned newWidth = (width > capacityWidth ? std::max(width, capacityWidth + capacityWidth / 2) : capacityWidth);
+                unsigned newHeight = (height > capacityHeight ? std::max(height, capacityHeight + capacityHeight / 2) : capacityHeight);
+                reallocate(newWidth, newHeight, std::min(width, matrixWidth), (preserve ? std::min(height, matrixHeight) : 0));
+            }
+            matrixWidth = width;
+            matrixHeight = height;
+            matrixSize = width * height;
+        }
+
+        // Makes sure that the matrix can be resized up to a size without allocating
+        void reserve(unsigned width, unsigned height)
+        {
+            if (width > layout.getCapacityWidth() || height > layout.getCapacityHeight())
+                reallocate(std::max(width, layout.getCapacityWidth()), std::max(height, layout.getCapacityHeight()), matrixWidth, matrixHeight);
+        }
+
+        // Removes the extra capacity (some layouts round the capacity up)
+        void shrinkToFit()
+        {
+            Layout fitted;
+            fitted.setCapacity(matrixWidth, matrixHeight);
+            if (fitted.getStorageSize() != layout.getStorageSize())
+                reallocate(matrixWidth, matrixHeight, matrixWidth, matrixHeight);
         }
 
         // Removes all of the elements, so the size is 0x0
@@ -60,6 +113,7 @@ class Matrix
             matrixWidth = 0;
             matrixHeight = 0;
             matrixSize = 0;
+            layout = Layout();
             elements.clear();
             elements.shrink_to_fit();
         }
@@ -68,12 +122,12 @@ class Matrix
         // Note that they are (x, y), which is (column, row)
         Type& operator()(unsigned x, unsigned y)
         {
-            return elements[(y * matrixWidth) + x];
+            return elements[layout.getIndex(x, y)];
         }
 
         const Type& operator()(unsigned x, unsigned y) const
         {
-            return elements[(y * matrixWidth) + x];
+            return elements[layout.getIndex(x, y)];
         }
 
         unsigned width() const
@@ -91,33 +145,443 @@ class Matrix
             return matrixSize;
         }
 
-        using MatrixType = std::vector<Type>;
+        // The number of elements from the start of one row to the start of the next (with the row major layout)
+        unsigned pitch() const
+        {
+            return layout.getCapacityWidth();
+        }
+
+        // The size that the matrix can grow to without allocating
+        unsigned capacityWidth() const
+        {
+            return layout.getCapacityWidth();
+        }
+
+        unsigned capacityHeight() const
+        {
+            return layout.getCapacityHeight();
+        }
+
+        const Layout& getLayout() const
+        {
+            return layout;
+        }
+
+        // Sets all of the elements to a value
+        void fill(const Type& value)
+        {
+            if (layout.isDense(matrixWidth, matrixHeight))
+                fillElements(elements.data(), matrixSize, value, IsTrivial());
+            else
+                fillRect(0, 0, matrixWidth, matrixHeight, value);
+        }
+
+        // Sets the elements in a rectangle to a value, the rectangle is clipped to the matrix
+        void fillRect(unsigned x, unsigned y, unsigned width, unsigned height, const Type& value)
+        {
+            width = clipLength(x, width, matrixWidth);
+            height = clipLength(y, height, matrixHeight);
+            forEachRun(*this, x, y, x + width, y + height, [&](Type* run, unsigned length)
+            {
+                fillElements(run, length, value, IsTrivial());
+            });
+        }
+
+        // Copies a rectangle from a matrix (which can be this one) to a position in this matrix
+        // The rectangle is clipped to both matrices, and overlapping rectangles are copied correctly
+        void copyRect(const Matrix& source, unsigned sourceX, unsigned sourceY, unsigned width, unsigned height, unsigned destX, unsigned destY)
+        {
+            width = clipLength(destX, clipLength(sourceX, width, source.matrixWidth), matrixWidth);
+            height = clipLength(destY, clipLength(sourceY, height, source.matrixHeight), matrixHeight);
+            if (!width || !height)
+                return;
+            // Copy from the bottom row up when moving down inside of the same matrix, and right to left when moving right
+            bool reverseY = (&source == this && destY > sourceY);
+            bool reverseX = (&source == this && destY == sourceY && destX > sourceX);
+            for (unsigned i = 0; i < height; ++i)
+            {
+                unsigned row = (reverseY ? height - 1 - i : i);
+                const Type* sourceData = source.elements.data();
+                Type* destData = elements.data();
+                if (reverseX && std::min(source.layout.getRunLength(sourceX), layout.getRunLength(destX)) < width)
+                {
+                    // The row is split into multiple ranges, so copy one element at a time
+                    for (unsigned x = width; x-- > 0; )
+                        destData[layout.getIndex(destX + x, destY + row)] = sourceData[source.layout.getIndex(sourceX + x, sourceY + row)];
+                    continue;
+                }
+                for (unsigned x = 0; x < width; )
+                {
+                    unsigned length = std::min(std::min(source.layout.getRunLength(sourceX + x), layout.getRunLength(destX + x)), width - x);
+                    copyElements(sourceData + source.layout.getIndex(sourceX + x, sourceY + row),
+                                 destData + layout.getIndex(destX + x, destY + row), length, IsTrivial());
+                    x += length;
+                }
+            }
+        }
+
+        // Replaces every element with the result of calling a function with it
+        template <class Function>
+        void transform(Function function)
+        {
+            forEachRun(*this, 0, 0, matrixWidth, matrixHeight, [&](Type* element, unsigned length)
+            {
+                for (Type* end = element + length; element != end; ++element)
+                    *element = function(*element);
+            });
+        }
+
+        // Returns the number of elements equal to a value
+        unsigned count(const Type& value) const
+        {
+            using SimdSize = std::integral_constant<unsigned, IsInteger::value ? sizeof(Type) : 0>;
+            if (layout.isDense(matrixWidth, matrixHeight))
+                return countElements(elements.data(), matrixSize, value, SimdSize());
+            unsigned total = 0;
+            forEachRun(*this, 0, 0, matrixWidth, matrixHeight, [&](const Type* run, unsigned length)
+            {
+                total += countElements(run, length, value, SimdSize());
+            });
+            return total;
+        }
 
-        typename MatrixType::iterator begin()
+        // Returns true if the other matrix has the same size and elements
+        bool compare(const Matrix& other) const
         {
-            return elements.begin();
+            if (matrixWidth != other.matrixWidth || matrixHeight != other.matrixHeight)
+                return false;
+            if (layout.isDense(matrixWidth, matrixHeight) && other.layout.isDense(matrixWidth, matrixHeight))
+                return compareElements(elements.data(), other.elements.data(), matrixSize, IsInteger());
+            for (unsigned y = 0; y < matrixHeight; ++y)
+            {
+                for (unsigned x = 0; x < matrixWidth; )
+                {
+                    unsigned length = std::min(std::min(layout.getRunLength(x), other.layout.getRunLength(x)), matrixWidth - x);
+                    if (!compareElements(elements.data() + layout.getIndex(x, y), other.elements.data() + other.layout.getIndex(x, y), length, IsInteger()))
+                        return false;
+                    x += length;
+                }
+            }
+            return true;
         }
 
-        typename MatrixType::iterator end()
+        // Walks through the elements in storage order, skipping the unused capacity
+        template <class Value>
+        class Iterator
+        {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = typename std::remove_const<Value>::type;
+                using difference_type = std::ptrdiff_t;
+                using pointer = Value*;
+                using reference = Value&;
+
+                Iterator():
+                    data(nullptr),
+                    element(nullptr),
+                    runEnd(nullptr),
+                    layout(nullptr),
+                    width(0),
+                    height(0)
+                {
+                }
+
+                Iterator(Value* data, std::size_t index, const Layout& layout, unsigned width, unsigned height):
+                    data(data),
+                    layout(&layout),
+                    width(width),
+                    height(height)
+                {
+                    findRun(index);
+                }
+
+                // Non-const iterators can be converted to const iterators
+                operator Iterator<const value_type>() const
+                {
+                    return (layout ? Iterator<const value_type>(data, element - data, *layout, width, height) : Iterator<const value_type>());
+                }
+
+                reference operator*() const
+                {
+                    return *element;
+                }
+
+                pointer operator->() const
+                {
+                    return element;
+                }
+
+                Iterator& operator++()
+                {
+                    if (++element == runEnd)
+                        findRun(element - data);
+                    return *this;
+                }
+
+                Iterator operator++(int)
+                {
+                    Iterator previous = *this;
+                    ++*this;
+                    return previous;
+                }
+
+                bool operator==(const Iterator& other) const
+                {
+                    return element == other.element;
+                }
+
+                bool operator!=(const Iterator& other) const
+                {
+                    return element != other.element;
+                }
+
+            private:
+                // Moves to the first element at or after a storage index, and finds the end of the range it is in
+                void findRun(std::size_t index)
+                {
+                    index = layout->findNext(index, width, height);
+                    element = data + index;
+                    runEnd = element;
+                    if (index < layout->getStorageSize())
+                    {
+                        unsigned x, y;
+                        layout->getPosition(index, x, y);
+                        runEnd += std::min(layout->getRunLength(x), width - x);
+                    }
+                }
+
+                Value* data;
+                Value* element;
+                Value* runEnd;
+                const Layout* layout;
+                unsigned width;
+                unsigned height;
+        };
+
+        using iterator = Iterator<Type>;
+        using const_iterator = Iterator<const Type>;
+
+        iterator begin()
         {
-            return elements.end();
+            return iterator(elements.data(), 0, layout, matrixWidth, matrixHeight);
+        }
+
+        iterator end()
+        {
+            return iterator(elements.data(), layout.getStorageSize(), layout, matrixWidth, matrixHeight);
+        }
+
+        const_iterator begin() const
+        {
+            return const_iterator(elements.data(), 0, layout, matrixWidth, matrixHeight);
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator(elements.data(), layout.getStorageSize(), layout, matrixWidth, matrixHeight);
+        }
+
+        const_iterator cbegin() const
+        {
+            return begin();
+        }
+
+        const_iterator cend() const
+        {
+            return end();
+        }
+
+        // Returns the storage, which is in the order of the layout and includes the unused capacity
+        Type* data()
+        {
+            return elements.data();
+        }
+
+        const Type* data() const
+        {
+            return elements.data();
+        }
+
+        // Returns the first element of a row, the rest of the row follows it (only with the row major layout)
+        Type* getRow(unsigned y)
+        {
+            static_assert(std::is_same<Layout, RowMajorLayout>::value, "Rows are only contiguous with the row major layout");
+            return elements.data() + layout.getIndex(0, y);
+        }
+
+        const Type* getRow(unsigned y) const
+        {
+            static_assert(std::is_same<Layout, RowMajorLayout>::value, "Rows are only contiguous with the row major layout");
+            return elements.data() + layout.getIndex(0, y);
         }
 
     private:
-        void copyMatrix(const std::vector<Type>& source, std::vector<Type>& dest, unsigned sourceWidth, unsigned destWidth, unsigned sourceHeight, unsigned destHeight) const
+        using IsTrivial = std::integral_constant<bool, std::is_trivially_copyable<Type>::value>;
+        using IsInteger = std::integral_constant<bool, std::is_integral<Type>::value || std::is_enum<Type>::value>;
+
+        // Calls a function with each range of elements that are next to each other in storage, in [x, endX) of the rows [y, endY)
+        template <class MatrixRef, class Function>
+        static void forEachRun(MatrixRef& matrix, unsigned x, unsigned y, unsigned endX, unsigned endY, Function function)
+        {
+            for (; y < endY; ++y)
+            {
+                for (unsigned runX = x; runX < endX; )
+                {
+                    unsigned length = std::min(matrix.layout.getRunLength(runX), endX - runX);
+                    function(matrix.elements.data() + matrix.layout.getIndex(runX, y), length);
+                    runX += length;
+                }
+            }
+        }
+
+        // Moves the elements into new memory with a different capacity
+        void reallocate(unsigned capacityWidth, unsigned capacityHeight, unsigned keepWidth, unsigned keepHeight)
+        {
+            Layout newLayout;
+            newLayout.setCapacity(capacityWidth, capacityHeight);
+            MatrixType newElements(newLayout.getStorageSize());
+            for (unsigned y = 0; y < keepHeight; ++y)
+            {
+                for (unsigned x = 0; x < keepWidth; )
+                {
+                    unsigned length = std::min(std::min(layout.getRunLength(x), newLayout.getRunLength(x)), keepWidth - x);
+                    moveElements(elements.data() + layout.getIndex(x, y), newElements.data() + newLayout.getIndex(x, y), length, IsTrivial());
+                    x += length;
+                }
+            }
+            elements.swap(newElements);
+            layout = newLayout;
+        }
+
+        // Default constructs the elements in [x, endX) of the rows [y, endY)
+        void resetRect(unsigned x, unsigned y, unsigned endX, unsigned endY)
+        {
+            forEachRun(*this, x, y, endX, endY, [](Type* run, unsigned length)
+            {
+                fillElements(run, length, Type(), IsTrivial());
+            });
+        }
+
+        static void moveElements(Type* source, Type* dest, std::size_t count, std::true_type)
+        {
+            if (count)
+                std::memcpy(dest, source, count * sizeof(Type));
+        }
+
+        static void moveElements(Type* source, Type* dest, std::size_t count, std::false_type)
+        {
+            std::move(source, source + count, dest);
+        }
+
+        // Returns the length of a range starting at position that fits in size
+        static unsigned clipLength(unsigned position, unsigned length, unsigned size)
+        {
+            return (position < size ? std::min(length, size - position) : 0);
+        }
+
+        static void fillElements(Type* dest, std::size_t count, const Type& value, std::true_type)
+        {
+            // Use memset when all of the bytes of the value are the same, like 0 or -1
+            unsigned char bytes[sizeof(Type)];
+            std::memcpy(bytes, &value, sizeof(Type));
+            if (std::all_of(bytes, bytes + sizeof(Type), [&](unsigned char byte){ return byte == bytes[0]; }))
+            {
+                if (count)
+                    std::memset(dest, bytes[0], count * sizeof(Type));
+            }
+            else
+                std::fill_n(dest, count, value);
+        }
+
+        static void fillElements(Type* dest, std::size_t count, const Type& value, std::false_type)
+        {
+            std::fill_n(dest, count, value);
+        }
+
+        static void copyElements(const Type* source, Type* dest, std::size_t count, std::true_type)
+        {
+            std::memmove(dest, source, count * sizeof(Type));
+        }
+
+        static void copyElements(const Type* source, Type* dest, std::size_t count, std::false_type)
+        {
+            if (dest > source && dest < source + count)
+                std::copy_backward(source, source + count, dest + count);
+            else
+                std::copy(source, source + count, dest);
+        }
+
+        template <unsigned Size>
+        static unsigned countElements(const Type* elements, std::size_t count, const Type& value, std::integral_constant<unsigned, Size>)
+        {
+            unsigned total = 0;
+            for (std::size_t i = 0; i < count; ++i)
+                total += (elements[i] == value);
+            return total;
+        }
+
+#ifdef NG_MATRIX_SSE2
+        static unsigned countElements(const Type* elements, std::size_t count, const Type& value, std::integral_constant<unsigned, 1>)
+        {
+            char target;
+            std::memcpy(&target, &value, 1);
+            const __m128i targets = _mm_set1_epi8(target);
+            const __m128i zero = _mm_setzero_si128();
+            std::size_t vectorEnd = count & ~std::size_t(15);
+            std::size_t i = 0;
+            unsigned total = 0;
+            while (i < vectorEnd)
+            {
+                // Each byte lane counts matches up to 255 times before being added up
+                std::size_t blockEnd = std::min(vectorEnd, i + 255 * 16);
+                __m128i sums = zero;
+                for (; i < blockEnd; i += 16)
+                {
+                    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i));
+                    sums = _mm_sub_epi8(sums, _mm_cmpeq_epi8(block, targets));
+                }
+                sums = _mm_sad_epu8(sums, zero);
+                total += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+            }
+            for (; i < count; ++i)
+                total += (elements[i] == value);
+            return total;
+        }
+
+        static unsigned countElements(const Type* elements, std::size_t count, const Type& value, std::integral_constant<unsigned, 4>)
+        {
+            int target;
+            std::memcpy(&target, &value, 4);
+            const __m128i targets = _mm_set1_epi32(target);
+            std::size_t vectorEnd = count & ~std::size_t(3);
+            __m128i sums = _mm_setzero_si128();
+            std::size_t i = 0;
+            for (; i < vectorEnd; i += 4)
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i));
+                sums = _mm_sub_epi32(sums, _mm_cmpeq_epi32(block, targets));
+            }
+            unsigned lanes[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+            unsigned total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            for (; i < count; ++i)
+                total += (elements[i] == value);
+            return total;
+        }
+#endif
+
+        static bool compareElements(const Type* first, const Type* second, std::size_t count, std::true_type)
+        {
+            return (!count || std::memcmp(first, second, count * sizeof(Type)) == 0);
+        }
+
+        static bool compareElements(const Type* first, const Type* second, std::size_t count, std::false_type)
         {
-            unsigned height = std::min(sourceHeight, destHeight);
-            unsigned width = std::min(sourceWidth, destWidth);
-            // Fill data
-            dest.clear();
-            dest.resize(destWidth * destHeight);
-            // Copy data
-            for (unsigned y = 0; y < height; ++y)
-                for (unsigned x = 0; x < width; ++x)
-                    dest[(y * destWidth) + x] = source[(y * sourceWidth) + x];
+            return std::equal(first, first + count, second);
         }
 
         MatrixType elements;
+        Layout layout;
         unsigned matrixWidth;
         unsigned matrixHeight;
         unsigned matrixSize;
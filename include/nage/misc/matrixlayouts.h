@@ -0,0 +1,336 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef MATRIXLAYOUTS_H
+#define MATRIXLAYOUTS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ng
+{
+
+/*
+These classes decide where each element of a Matrix is stored, which is passed as its second template parameter.
+    RowMajorLayout: Each row is stored after the previous one, which is best for scanning rows.
+    TiledLayout: The matrix is split into square tiles (8x8 by default), which are stored one after another.
+        Neighbors in other rows are usually in the same tile, which helps 3x3 kernels and radius scans.
+    MortonLayout: The elements are stored in Z-order, by interleaving the bits of x and y.
+        Neighbors are close in memory at every scale, but the capacity is rounded up to powers of two.
+        The parts of the index from each column and row are stored in tables, so getting an index is two lookups.
+
+Every layout has the same functions, which only depend on the capacity and not the size of the matrix:
+    setCapacity(width, height): Sets the capacity, which can be rounded up
+    getCapacityWidth(), getCapacityHeight(), getStorageSize(): The capacity, and the number of elements to allocate
+    getIndex(x, y) and getPosition(index, x, y): Converts between positions and storage indices
+    getRunLength(x): The number of elements starting at column x that are next to each other in storage (at least 1)
+    findNext(index, width, height): The first storage index at or after index that is in a matrix of that size,
+        or the storage size if there are none
+    isDense(width, height): True if a matrix of that size uses exactly [0, width * height) of the storage,
+        in an order that only depends on the size
+
+Example:
+    Matrix<float, MortonLayout> influence(1024, 1024);
+    Matrix<unsigned, TiledLayout<16>> costs(512, 512);
+*/
+
+class RowMajorLayout
+{
+    public:
+        RowMajorLayout():
+            pitch(0),
+            rows(0)
+        {
+        }
+
+        void setCapacity(unsigned width, unsigned height)
+        {
+            pitch = width;
+            rows = height;
+        }
+
+        unsigned getCapacityWidth() const
+        {
+            return pitch;
+        }
+
+        unsigned getCapacityHeight() const
+        {
+            return rows;
+        }
+
+        std::size_t getStorageSize() const
+        {
+            return static_cast<std::size_t>(pitch) * rows;
+        }
+
+        std::size_t getIndex(unsigned x, unsigned y) const
+        {
+            return (static_cast<std::size_t>(y) * pitch) + x;
+        }
+
+        void getPosition(std::size_t index, unsigned& x, unsigned& y) const
+        {
+            x = index % pitch;
+            y = index / pitch;
+        }
+
+        unsigned getRunLength(unsigned x) const
+        {
+            return pitch - x;
+        }
+
+        std::size_t findNext(std::size_t index, unsigned width, unsigned height) const
+        {
+            if (!width || index >= getStorageSize())
+                return getStorageSize();
+            unsigned x, y;
+            getPosition(index, x, y);
+            // Skip the unused capacity at the end of the row
+            if (x >= width)
+                return (y + 1 < height ? getIndex(0, y + 1) : getStorageSize());
+            return (y < height ? index : getStorageSize());
+        }
+
+        bool isDense(unsigned width, unsigned height) const
+        {
+            return (width == pitch || height <= 1);
+        }
+
+    private:
+        unsigned pitch;
+        unsigned rows;
+};
+
+template <unsigned TileSize = 8>
+class TiledLayout
+{
+    static_assert(TileSize && !(TileSize & (TileSize - 1)), "The tile size must be a power of two");
+
+    // Returns the base 2 logarithm of a power of two
+    static constexpr unsigned log2(unsigned value)
+    {
+        return (value > 1 ? 1 + log2(value >> 1) : 0);
+    }
+
+    static const unsigned shift = log2(TileSize);
+    static const unsigned mask = TileSize - 1;
+
+    public:
+        TiledLayout():
+            capacityWidth(0),
+            capacityHeight(0),
+            tilesPerRow(0)
+        {
+        }
+
+        void setCapacity(unsigned width, unsigned height)
+        {
+            capacityWidth = (width + mask) & ~mask;
+            capacityHeight = (height + mask) & ~mask;
+            tilesPerRow = capacityWidth >> shift;
+        }
+
+        unsigned getCapacityWidth() const
+        {
+            return capacityWidth;
+        }
+
+        unsigned getCapacityHeight() const
+        {
+            return capacityHeight;
+        }
+
+        std::size_t getStorageSize() const
+        {
+            return static_cast<std::size_t>(capacityWidth) * capacityHeight;
+        }
+
+        std::size_t getIndex(unsigned x, unsigned y) const
+        {
+            std::size_t tile = (static_cast<std::size_t>(y >> shift) * tilesPerRow) + (x >> shift);
+            return (tile << (shift * 2)) + ((y & mask) << shift) + (x & mask);
+        }
+
+        void getPosition(std::size_t index, unsigned& x, unsigned& y) const
+        {
+            std::size_t tile = index >> (shift * 2);
+            unsigned inner = index & ((TileSize * TileSize) - 1);
+            x = ((tile % tilesPerRow) << shift) | (inner & mask);
+            y = ((tile / tilesPerRow) << shift) | (inner >> shift);
+        }
+
+        unsigned getRunLength(unsigned x) const
+        {
+            return TileSize - (x & mask);
+        }
+
+        std::size_t findNext(std::size_t index, unsigned width, unsigned height) const
+        {
+            std::size_t size = getStorageSize();
+            while (index < size)
+            {
+                unsigned x, y;
+                getPosition(index, x, y);
+                if (x < width && y < height)
+                    return index;
+                if (y >= height || (x & ~mask) >= width)
+                    index = ((index >> (shift * 2)) + 1) << (shift * 2); // Skip to the next tile
+                else
+                    index = (index | mask) + 1; // Skip to the next row in the tile
+            }
+            return size;
+        }
+
+        bool isDense(unsigned width, unsigned height) const
+        {
+            return (width == capacityWidth && height == capacityHeight);
+        }
+
+    private:
+        unsigned capacityWidth;
+        unsigned capacityHeight;
+        unsigned tilesPerRow;
+};
+
+class MortonLayout
+{
+    public:
+        MortonLayout():
+            capacityWidth(0),
+            capacityHeight(0),
+            bitsX(0),
+            bitsY(0),
+            sharedBits(0)
+        {
+        }
+
+        void setCapacity(unsigned width, unsigned height)
+        {
+            bitsX = getBits(width);
+            bitsY = getBits(height);
+            sharedBits = std::min(bitsX, bitsY);
+            capacityWidth = (width ? 1u << bitsX : 0);
+            capacityHeight = (height ? 1u << bitsY : 0);
+            // The bits of x and y never overlap in the index, so the offset of each column and row can be looked up
+            columnOffsets.resize(capacityWidth);
+            for (unsigned x = 0; x < capacityWidth; ++x)
+                columnOffsets[x] = getOffset(x, bitsX > bitsY, 0);
+            rowOffsets.resize(capacityHeight);
+            for (unsigned y = 0; y < capacityHeight; ++y)
+                rowOffsets[y] = getOffset(y, bitsY > bitsX, 1);
+        }
+
+        unsigned getCapacityWidth() const
+        {
+            return capacityWidth;
+        }
+
+        unsigned getCapacityHeight() const
+        {
+            return capacityHeight;
+        }
+
+        std::size_t getStorageSize() const
+        {
+            return static_cast<std::size_t>(capacityWidth) * capacityHeight;
+        }
+
+        std::size_t getIndex(unsigned x, unsigned y) const
+        {
+            return columnOffsets[x] | rowOffsets[y];
+        }
+
+        void getPosition(std::size_t index, unsigned& x, unsigned& y) const
+        {
+            std::uint64_t lower = index & ((std::uint64_t(1) << (sharedBits * 2)) - 1);
+            unsigned upper = static_cast<unsigned>(index >> (sharedBits * 2)) << sharedBits;
+            x = compactBits(lower);
+            y = compactBits(lower >> 1);
+            if (bitsX > bitsY)
+                x |= upper;
+            else
+                y |= upper;
+        }
+
+        unsigned getRunLength(unsigned x) const
+        {
+            // Pairs of columns are next to each other, unless the matrix is only one row or column wide
+            return (sharedBits ? 2 - (x & 1) : capacityWidth - x);
+        }
+
+        std::size_t findNext(std::size_t index, unsigned width, unsigned height) const
+        {
+            std::size_t size = getStorageSize();
+            for (; index < size; ++index)
+            {
+                unsigned x, y;
+                getPosition(index, x, y);
+                if (x < width && y < height)
+                    return index;
+            }
+            return size;
+        }
+
+        bool isDense(unsigned width, unsigned height) const
+        {
+            return (width == capacityWidth && height == capacityHeight);
+        }
+
+    private:
+        // Returns the bits that a column or row sets in the index
+        std::size_t getOffset(unsigned position, bool hasUpperBits, unsigned interleaveShift) const
+        {
+            // The bits that only one dimension has are stored above the interleaved bits
+            std::uint32_t sharedMask = (std::uint32_t(1) << sharedBits) - 1;
+            std::size_t upper = (hasUpperBits ? static_cast<std::size_t>(position >> sharedBits) << (sharedBits * 2) : 0);
+            return static_cast<std::size_t>(spreadBits(position & sharedMask) << interleaveShift) | upper;
+        }
+
+        // Returns the number of bits needed for a power of two that is at least the size (0 for sizes of 0 or 1)
+        static unsigned getBits(unsigned size)
+        {
+            unsigned bits = 0;
+            while ((std::uint64_t(1) << bits) < size)
+                ++bits;
+            return bits;
+        }
+
+        // Inserts a 0 bit in between each bit of a value
+        static std::uint64_t spreadBits(std::uint32_t value)
+        {
+            std::uint64_t bits = value;
+            bits = (bits | (bits << 16)) & 0x0000FFFF0000FFFFull;
+            bits = (bits | (bits << 8)) & 0x00FF00FF00FF00FFull;
+            bits = (bits | (bits << 4)) & 0x0F0F0F0F0F0F0F0Full;
+            bits = (bits | (bits << 2)) & 0x3333333333333333ull;
+            bits = (bits | (bits << 1)) & 0x5555555555555555ull;
+            return bits;
+        }
+
+        // Removes every other bit of a value, which undoes spreadBits()
+        static unsigned compactBits(std::uint64_t bits)
+        {
+            bits &= 0x5555555555555555ull;
+            bits = (bits | (bits >> 1)) & 0x3333333333333333ull;
+            bits = (bits | (bits >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+            bits = (bits | (bits >> 4)) & 0x00FF00FF00FF00FFull;
+            bits = (bits | (bits >> 8)) & 0x0000FFFF0000FFFFull;
+            bits = (bits | (bits >> 16)) & 0x00000000FFFFFFFFull;
+            return static_cast<unsigned>(bits);
+        }
+
+        unsigned capacityWidth;
+        unsigned capacityHeight;
+        unsigned bitsX;
+        unsigned bitsY;
+        unsigned sharedBits; // The number of low bits of x and y that are interleaved
+        std::vector<std::size_t> columnOffsets;
+        std::vector<std::size_t> rowOffsets;
+};
+
+}
+
+#endif
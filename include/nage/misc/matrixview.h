@@ -0,0 +1,323 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef MATRIXVIEW_H
+#define MATRIXVIEW_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+#include <type_traits>
+#include <functional>
+#include "nage/misc/matrix.h"
+
+namespace ng
+{
+
+/*
+This class refers to a rectangle of elements in memory that someone else owns, like a Matrix.
+Each row starts stride elements after the previous one, so a view can cover part of a bigger matrix without copying it.
+    Views are cheap to copy, and getSubview() makes smaller views, which can be handed to other threads.
+    Use MatrixView<const Type> for read only views. Views must not outlive the memory they refer to,
+        and resizing the matrix invalidates them.
+Only matrices with the row major layout can be viewed, since the other layouts don't have strided rows.
+The iterators walk through the rows from top to bottom.
+
+Example:
+    Matrix<unsigned> costs(1024, 1024);
+    MatrixView<unsigned> room(costs, 100, 200, 16, 12);
+    room.fill(1);
+    room.floodFill(4, 4, 2);
+    ThreadPool::getDefault().parallelFor(costs.height(), [&](unsigned begin, unsigned end)
+    {
+        MatrixView<unsigned>(costs, 0, begin, costs.width(), end - begin).transform(updateCost);
+    });
+*/
+template <class Type>
+class MatrixView
+{
+    public:
+        using ElementType = typename std::remove_const<Type>::type;
+
+        MatrixView():
+            viewData(nullptr),
+            viewWidth(0),
+            viewHeight(0),
+            viewStride(0)
+        {
+        }
+
+        MatrixView(Type* data, unsigned width, unsigned height, unsigned stride):
+            viewData(data),
+            viewWidth(width),
+            viewHeight(height),
+            viewStride(stride)
+        {
+        }
+
+        // Views a whole matrix, or a rectangle of it which is clipped to the matrix
+        MatrixView(Matrix<ElementType>& matrix):
+            MatrixView(matrix.data(), matrix.width(), matrix.height(), matrix.pitch())
+        {
+        }
+
+        MatrixView(const Matrix<ElementType>& matrix):
+            MatrixView(matrix.data(), matrix.width(), matrix.height(), matrix.pitch())
+        {
+        }
+
+        MatrixView(Matrix<ElementType>& matrix, unsigned x, unsigned y, unsigned width, unsigned height):
+            MatrixView(MatrixView(matrix).getSubview(x, y, width, height))
+        {
+        }
+
+        MatrixView(const Matrix<ElementType>& matrix, unsigned x, unsigned y, unsigned width, unsigned height):
+            MatrixView(MatrixView(matrix).getSubview(x, y, width, height))
+        {
+        }
+
+        // Views can be converted to read only views
+        operator MatrixView<const ElementType>() const
+        {
+            return MatrixView<const ElementType>(viewData, viewWidth, viewHeight, viewStride);
+        }
+
+        // Note that positions are (x, y), which is (column, row), like Matrix
+        Type& operator()(unsigned x, unsigned y) const
+        {
+            return viewData[(static_cast<std::size_t>(y) * viewStride) + x];
+        }
+
+        // Returns the first element of a row, which is followed by the rest of the row
+        Type* getRow(unsigned y) const
+        {
+            return viewData + (static_cast<std::size_t>(y) * viewStride);
+        }
+
+        // Returns a view of a rectangle inside of this view, which is clipped to this view
+        MatrixView getSubview(unsigned x, unsigned y, unsigned width, unsigned height) const
+        {
+            if (x >= viewWidth || y >= viewHeight)
+                return MatrixView();
+            return MatrixView(&(*this)(x, y), std::min(width, viewWidth - x), std::min(height, viewHeight - y), viewStride);
+        }
+
+        Type* data() const
+        {
+            return viewData;
+        }
+
+        unsigned width() const
+        {
+            return viewWidth;
+        }
+
+        unsigned height() const
+        {
+            return viewHeight;
+        }
+
+        // The number of elements from the start of one row to the start of the next
+        unsigned stride() const
+        {
+            return viewStride;
+        }
+
+        unsigned size() const
+        {
+            return viewWidth * viewHeight;
+        }
+
+        bool empty() const
+        {
+            return (viewWidth == 0 || viewHeight == 0);
+        }
+
+        // Sets all of the elements to a value
+        void fill(const ElementType& value) const
+        {
+            for (unsigned y = 0; y < viewHeight; ++y)
+                std::fill_n(getRow(y), viewWidth, value);
+        }
+
+        // Copies the elements of another view to this one, starting at the top left corners
+        // Only the area that fits in both views is copied, and views that overlap in memory are copied correctly
+        void copy(const MatrixView<const ElementType>& source) const
+        {
+            unsigned width = std::min(viewWidth, source.width());
+            unsigned height = std::min(viewHeight, source.height());
+            if (!width || !height)
+                return;
+            // Copy backwards when the destination is later in memory, so elements are read before being overwritten
+            bool reverse = std::less<const ElementType*>()(source.data(), viewData);
+            for (unsigned i = 0; i < height; ++i)
+            {
+                unsigned y = (reverse ? height - 1 - i : i);
+                const ElementType* sourceRow = source.getRow(y);
+                if (reverse)
+                    std::copy_backward(sourceRow, sourceRow + width, getRow(y) + width);
+                else
+                    std::copy(sourceRow, sourceRow + width, getRow(y));
+            }
+        }
+
+        // Replaces every element with the result of calling a function with it
+        template <class Function>
+        void transform(Function function) const
+        {
+            for (unsigned y = 0; y < viewHeight; ++y)
+            {
+                Type* element = getRow(y);
+                for (Type* end = element + viewWidth; element != end; ++element)
+                    *element = function(*element);
+            }
+        }
+
+        // Returns the number of elements equal to a value
+        unsigned count(const ElementType& value) const
+        {
+            unsigned total = 0;
+            for (unsigned y = 0; y < viewHeight; ++y)
+                total += std::count(getRow(y), getRow(y) + viewWidth, value);
+            return total;
+        }
+
+        // Replaces the elements connected to a position (in 4 directions) that are equal to it with a value
+        // Returns the number of elements that were replaced
+        unsigned floodFill(unsigned x, unsigned y, const ElementType& value) const
+        {
+            if (x >= viewWidth || y >= viewHeight || (*this)(x, y) == value)
+                return 0;
+            ElementType target = (*this)(x, y);
+            unsigned filled = 0;
+            // Each seed fills the whole run of matching elements in its row, then adds seeds for the runs above and below
+            std::vector<std::pair<unsigned, unsigned>> seeds(1, std::make_pair(x, y));
+            while (!seeds.empty())
+            {
+                auto seed = seeds.back();
+                seeds.pop_back();
+                Type* row = getRow(seed.second);
+                if (!(row[seed.first] == target))
+                    continue;
+                unsigned left = seed.first;
+                unsigned right = seed.first + 1;
+                while (left > 0 && row[left - 1] == target)
+                    --left;
+                while (right < viewWidth && row[right] == target)
+                    ++right;
+                std::fill(row + left, row + right, value);
+                filled += right - left;
+                for (unsigned nextY: {seed.second - 1, seed.second + 1})
+                {
+                    if (nextY >= viewHeight) // Also skips the row above the first one, since it wraps around
+                        continue;
+                    const Type* nextRow = getRow(nextY);
+                    bool inRun = false;
+                    for (unsigned i = left; i < right; ++i)
+                    {
+                        bool matches = (nextRow[i] == target);
+                        if (matches && !inRun)
+                            seeds.emplace_back(i, nextY);
+                        inRun = matches;
+                    }
+                }
+            }
+            return filled;
+        }
+
+        // Walks through the rows from top to bottom
+        class Iterator
+        {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = ElementType;
+                using difference_type = std::ptrdiff_t;
+                using pointer = Type*;
+                using reference = Type&;
+
+                Iterator():
+                    element(nullptr),
+                    rowEnd(nullptr),
+                    rowsLeft(0),
+                    width(0),
+                    stride(0)
+                {
+                }
+
+                Iterator(Type* element, unsigned rowsLeft, unsigned width, unsigned stride):
+                    element(element),
+                    rowEnd(element + width),
+                    rowsLeft(rowsLeft),
+                    width(width),
+                    stride(stride)
+                {
+                }
+
+                reference operator*() const
+                {
+                    return *element;
+                }
+
+                pointer operator->() const
+                {
+                    return element;
+                }
+
+                Iterator& operator++()
+                {
+                    // The end of the last row is the end iterator, so it never points past the viewed memory
+                    if (++element == rowEnd && --rowsLeft)
+                    {
+                        element += stride - width;
+                        rowEnd += stride;
+                    }
+                    return *this;
+                }
+
+                Iterator operator++(int)
+                {
+                    Iterator previous = *this;
+                    ++*this;
+                    return previous;
+                }
+
+                bool operator==(const Iterator& other) const
+                {
+                    return element == other.element;
+                }
+
+                bool operator!=(const Iterator& other) const
+                {
+                    return element != other.element;
+                }
+
+            private:
+                Type* element;
+                Type* rowEnd;
+                unsigned rowsLeft;
+                unsigned width;
+                unsigned stride;
+        };
+
+        Iterator begin() const
+        {
+            return (empty() ? end() : Iterator(viewData, viewHeight, viewWidth, viewStride));
+        }
+
+        Iterator end() const
+        {
+            return (empty() ? Iterator(viewData, 0, 0, viewStride) : Iterator(getRow(viewHeight - 1) + viewWidth, 0, 0, viewStride));
+        }
+
+    private:
+        Type* viewData;
+        unsigned viewWidth;
+        unsigned viewHeight;
+        unsigned viewStride;
+};
+
+}
+
+#endif
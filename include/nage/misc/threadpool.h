@@ -0,0 +1,67 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ng
+{
+
+/*
+This class runs tasks on a fixed set of worker threads.
+parallelFor() splits a range of indexes into pieces, runs them on the workers, and waits for them.
+    The calling thread works on the pieces too, so it is safe to call from inside a task.
+run() queues a single task, and returns a future which is ready once the task is done.
+getDefault() returns a pool shared by the whole engine, with a worker for each extra core.
+
+Example:
+    ThreadPool::getDefault().parallelFor(rows, [&](unsigned begin, unsigned end)
+    {
+        for (unsigned y = begin; y < end; ++y)
+            buildRow(y);
+    });
+*/
+class ThreadPool
+{
+    public:
+        // Uses a thread for each core (minus the calling thread) if the thread count is 0
+        explicit ThreadPool(unsigned threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Returns the number of worker threads
+        unsigned getThreadCount() const;
+
+        // Calls task(begin, end) on pieces of the range [0, count), and returns when all of them are done
+        // Pieces are at least minSize indexes, so small ranges are just run on the calling thread
+        void parallelFor(unsigned count, const std::function<void(unsigned, unsigned)>& task, unsigned minSize = 1);
+
+        // Queues a task to run on one of the worker threads
+        std::future<void> run(std::function<void()> task);
+
+        // Returns the pool shared by the engine
+        static ThreadPool& getDefault();
+
+    private:
+        void work();
+
+        std::vector<std::thread> threads;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping;
+};
+
+}
+
+#endif
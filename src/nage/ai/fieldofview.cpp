@@ -0,0 +1,169 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/ai/fieldofview.h"
+#include <mutex>
+#include "nage/misc/threadpool.h"
+
+namespace ng
+{
+
+// Smallest number of viewers worth splitting between threads
+static const unsigned minParallelViewers = 4;
+
+// Transforms the coordinates of each octant into grid coordinates (xx, xy, yx, yy)
+static const int octants[8][4] = {
+    {1, 0, 0, 1}, {0, 1, 1, 0}, {0, -1, 1, 0}, {-1, 0, 0, 1},
+    {-1, 0, 0, -1}, {0, -1, -1, 0}, {0, 1, -1, 0}, {1, 0, 0, -1}};
+
+FieldOfView::FieldOfView()
+{
+}
+
+void FieldOfView::setGrid(const Matrix<unsigned>& costs)
+{
+    opaqueCells.resize(costs.width(), costs.height());
+    for (unsigned y = 0; y < costs.height(); ++y)
+    {
+        for (unsigned x = 0; x < costs.width(); ++x)
+        {
+            if (!costs(x, y))
+                opaqueCells.set(x, y, true);
+        }
+    }
+}
+
+void FieldOfView::setGrid(const TileMap& tileMap, TileMap::LayerHandle layer, std::uint32_t opaque)
+{
+    const sf::Vector2u& mapSize = tileMap.getMapSize();
+    opaqueCells.resize(mapSize.x, mapSize.y);
+    for (unsigned y = 0; y < mapSize.y; ++y)
+    {
+        for (unsigned x = 0; x < mapSize.x; ++x)
+        {
+            if (tileMap.hasProperties(layer, x, y, opaque))
+                opaqueCells.set(x, y, true);
+        }
+    }
+}
+
+void FieldOfView::setOpaque(unsigned x, unsigned y, bool opaque)
+{
+    if (x < opaqueCells.width() && y < opaqueCells.height())
+        opaqueCells.set(x, y, opaque);
+}
+
+bool FieldOfView::isOpaque(unsigned x, unsigned y) const
+{
+    return (x >= opaqueCells.width() || y >= opaqueCells.height() || opaqueCells.get(x, y));
+}
+
+sf::Vector2u FieldOfView::getSize() const
+{
+    return sf::Vector2u(opaqueCells.width(), opaqueCells.height());
+}
+
+void FieldOfView::compute(const sf::Vector2u& position, unsigned radius, BitMatrix& visible) const
+{
+    prepare(visible);
+    add(position, radius, visible);
+}
+
+void FieldOfView::add(const sf::Vector2u& position, unsigned radius, BitMatrix& visible) const
+{
+    if (visible.width() != opaqueCells.width() || visible.height() != opaqueCells.height())
+        prepare(visible);
+    if (position.x >= opaqueCells.width() || position.y >= opaqueCells.height())
+        return;
+    visible.set(position.x, position.y, true);
+    for (auto& octant: octants)
+        castLight(position, radius, 1, 1.0f, 0.0f, octant[0], octant[1], octant[2], octant[3], visible);
+}
+
+void FieldOfView::compute(const std::vector<Viewer>& viewers, BitMatrix& visible) const
+{
+    // Each piece of viewers is computed separately, and then merged into the result
+    prepare(visible);
+    std::mutex mutex;
+    ThreadPool::getDefault().parallelFor(viewers.size(), [&](unsigned begin, unsigned end)
+    {
+        BitMatrix pieceVisible(opaqueCells.width(), opaqueCells.height());
+        for (unsigned i = begin; i < end; ++i)
+            add(viewers[i].position, viewers[i].radius, pieceVisible);
+        std::lock_guard<std::mutex> lock(mutex);
+        visible.merge(pieceVisible);
+    }, minParallelViewers);
+}
+
+void FieldOfView::computeEach(const std::vector<Viewer>& viewers, std::vector<BitMatrix>& results) const
+{
+    results.resize(viewers.size());
+    ThreadPool::getDefault().parallelFor(viewers.size(), [&](unsigned begin, unsigned end)
+    {
+        for (unsigned i = begin; i < end; ++i)
+            compute(viewers[i].position, viewers[i].radius, results[i]);
+    }, minParallelViewers);
+}
+
+void FieldOfView::castLight(const sf::Vector2u& position, unsigned radius, unsigned row, float start, float end,
+    int xx, int xy, int yx, int yy, BitMatrix& visible) const
+{
+    if (start < end)
+        return;
+    int width = opaqueCells.width();
+    int height = opaqueCells.height();
+    int radiusSquared = radius * radius;
+    float newStart = 0.0f;
+    for (int distance = row; distance <= static_cast<int>(radius); ++distance)
+    {
+        // Scan the row from the edge of the octant towards its diagonal
+        int dy = -distance;
+        bool blocked = false;
+        for (int dx = -distance; dx <= 0; ++dx)
+        {
+            float leftSlope = (dx - 0.5f) / (dy + 0.5f);
+            float rightSlope = (dx + 0.5f) / (dy - 0.5f);
+            if (start < rightSlope)
+                continue;
+            if (end > leftSlope)
+                break;
+
+            int x = static_cast<int>(position.x) + dx * xx + dy * xy;
+            int y = static_cast<int>(position.y) + dx * yx + dy * yy;
+            bool inside = (x >= 0 && y >= 0 && x < width && y < height);
+            if (inside && dx * dx + dy * dy <= radiusSquared)
+                visible.set(x, y, true);
+            bool opaque = (!inside || opaqueCells.get(x, y));
+            if (blocked)
+            {
+                // Keep skipping the cells in the shadow, until the first open cell starts a new scan
+                if (opaque)
+                    newStart = rightSlope;
+                else
+                {
+                    blocked = false;
+                    start = newStart;
+                }
+            }
+            else if (opaque && distance < static_cast<int>(radius))
+            {
+                // Scan the lit area before this blocker in the next rows
+                blocked = true;
+                castLight(position, radius, distance + 1, start, leftSlope, xx, xy, yx, yy, visible);
+                newStart = rightSlope;
+            }
+        }
+        if (blocked)
+            break;
+    }
+}
+
+void FieldOfView::prepare(BitMatrix& visible) const
+{
+    if (visible.width() != opaqueCells.width() || visible.height() != opaqueCells.height())
+        visible.resize(opaqueCells.width(), opaqueCells.height());
+    else
+        visible.fill(false);
+}
+
+}
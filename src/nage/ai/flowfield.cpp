@@ -0,0 +1,222 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/ai/flowfield.h"
+#include <queue>
+#include <vector>
+#include <limits>
+#include <functional>
+#include <algorithm>
+#include "nage/misc/threadpool.h"
+
+namespace ng
+{
+
+static const float unreachable = std::numeric_limits<float>::infinity();
+
+static const float diagonalCost = 1.41421356f;
+static const float diagonalLength = 0.70710678f;
+
+// Smallest amounts of work worth splitting between threads
+static const unsigned minParallelCells = 1024;
+static const unsigned minParallelRows = 64;
+
+// The 8 neighbor offsets, and the unit vectors pointing at them (the last one is for no direction)
+static const int offsets[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+static const sf::Vector2f unitVectors[9] = {
+    {-diagonalLength, -diagonalLength}, {0, -1}, {diagonalLength, -diagonalLength},
+    {-1, 0}, {1, 0},
+    {-diagonalLength, diagonalLength}, {0, 1}, {diagonalLength, diagonalLength},
+    {0, 0}};
+
+// Returns true if a unit can move from a cell in a direction without cutting a corner
+static bool canStep(const Matrix<unsigned>& costs, unsigned x, unsigned y, int dx, int dy)
+{
+    int nextX = static_cast<int>(x) + dx;
+    int nextY = static_cast<int>(y) + dy;
+    if (nextX < 0 || nextY < 0 || nextX >= static_cast<int>(costs.width()) || nextY >= static_cast<int>(costs.height()) ||
+        !costs(nextX, nextY))
+        return false;
+    return (dx == 0 || dy == 0 || (costs(nextX, y) && costs(x, nextY)));
+}
+
+// Returns the cost of moving between two neighboring cells, which is the same in both directions
+static float getStepCost(const Matrix<unsigned>& costs, unsigned x, unsigned y, int dx, int dy)
+{
+    float cost = (costs(x, y) + costs(x + dx, y + dy)) * 0.5f;
+    return (dx != 0 && dy != 0 ? cost * diagonalCost : cost);
+}
+
+FlowField::FlowField()
+{
+}
+
+void FlowField::build(const Matrix<unsigned>& costs, const sf::Vector2u& goal, bool parallel)
+{
+    this->goal = goal;
+    integration.resize(costs.width(), costs.height(), false);
+    integration.fill(unreachable);
+    if (goal.x < costs.width() && goal.y < costs.height() && costs(goal.x, goal.y))
+    {
+        integration(goal.x, goal.y) = 0;
+        if (parallel)
+            integrateParallel(costs);
+        else
+            integrate(costs);
+    }
+    buildDirections(costs, parallel);
+}
+
+const sf::Vector2u& FlowField::getGoal() const
+{
+    return goal;
+}
+
+sf::Vector2u FlowField::getSize() const
+{
+    return sf::Vector2u(integration.width(), integration.height());
+}
+
+float FlowField::getCost(unsigned x, unsigned y) const
+{
+    return (x < integration.width() && y < integration.height() ? integration(x, y) : unreachable);
+}
+
+bool FlowField::isReachable(unsigned x, unsigned y) const
+{
+    return (getCost(x, y) != unreachable);
+}
+
+const sf::Vector2f& FlowField::getDirection(unsigned x, unsigned y) const
+{
+    if (x < directions.width() && y < directions.height())
+        return unitVectors[directions(x, y)];
+    return unitVectors[noDirection];
+}
+
+const sf::Vector2f& FlowField::getDirection(const sf::Vector2f& position, const sf::Vector2f& tileSize) const
+{
+    if (position.x < 0 || position.y < 0)
+        return unitVectors[noDirection];
+    return getDirection(static_cast<unsigned>(position.x / tileSize.x), static_cast<unsigned>(position.y / tileSize.y));
+}
+
+void FlowField::integrate(const Matrix<unsigned>& costs)
+{
+    using OpenEntry = std::pair<float, unsigned>;
+    std::priority_queue<OpenEntry, std::vector<OpenEntry>, std::greater<OpenEntry>> open;
+    unsigned width = costs.width();
+    open.emplace(0.0f, goal.y * width + goal.x);
+    while (!open.empty())
+    {
+        OpenEntry entry = open.top();
+        open.pop();
+        unsigned x = entry.second % width;
+        unsigned y = entry.second / width;
+        if (entry.first > integration(x, y))
+            continue;
+        for (auto& offset: offsets)
+        {
+            if (!canStep(costs, x, y, offset[0], offset[1]))
+                continue;
+            unsigned nextX = x + offset[0];
+            unsigned nextY = y + offset[1];
+            float cost = entry.first + getStepCost(costs, x, y, offset[0], offset[1]);
+            if (cost < integration(nextX, nextY))
+            {
+                integration(nextX, nextY) = cost;
+                open.emplace(cost, nextY * width + nextX);
+            }
+        }
+    }
+}
+
+void FlowField::integrateParallel(const Matrix<unsigned>& costs)
+{
+    // Each wavefront is the set of cells next to the cells that changed in the last one
+    // Their new costs only read the integration field, so they can be computed in any order
+    unsigned width = costs.width();
+    std::vector<unsigned> changed(1, goal.y * width + goal.x);
+    std::vector<unsigned> wavefront;
+    std::vector<float> results;
+    std::vector<bool> queued(costs.size());
+    while (!changed.empty())
+    {
+        wavefront.clear();
+        for (unsigned cell: changed)
+        {
+            unsigned x = cell % width;
+            unsigned y = cell / width;
+            for (auto& offset: offsets)
+            {
+                unsigned next = (y + offset[1]) * width + x + offset[0];
+                if (canStep(costs, x, y, offset[0], offset[1]) && !queued[next])
+                {
+                    queued[next] = true;
+                    wavefront.push_back(next);
+                }
+            }
+        }
+
+        results.resize(wavefront.size());
+        ThreadPool::getDefault().parallelFor(wavefront.size(), [&](unsigned begin, unsigned end)
+        {
+            for (unsigned i = begin; i < end; ++i)
+            {
+                unsigned x = wavefront[i] % width;
+                unsigned y = wavefront[i] / width;
+                float best = integration(x, y);
+                for (auto& offset: offsets)
+                {
+                    if (canStep(costs, x, y, offset[0], offset[1]))
+                        best = std::min(best, integration(x + offset[0], y + offset[1]) + getStepCost(costs, x, y, offset[0], offset[1]));
+                }
+                results[i] = best;
+            }
+        }, minParallelCells);
+
+        changed.clear();
+        for (unsigned i = 0; i < wavefront.size(); ++i)
+        {
+            unsigned cell = wavefront[i];
+            queued[cell] = false;
+            float& cost = integration(cell % width, cell / width);
+            if (results[i] < cost)
+            {
+                cost = results[i];
+                changed.push_back(cell);
+            }
+        }
+    }
+}
+
+void FlowField::buildDirections(const Matrix<unsigned>& costs, bool parallel)
+{
+    directions.resize(costs.width(), costs.height(), false);
+    auto buildRows = [&](unsigned begin, unsigned end)
+    {
+        for (unsigned y = begin; y < end; ++y)
+        {
+            for (unsigned x = 0; x < costs.width(); ++x)
+            {
+                std::uint8_t direction = noDirection;
+                float best = integration(x, y);
+                for (unsigned i = 0; i < 8 && costs(x, y); ++i)
+                {
+                    if (canStep(costs, x, y, offsets[i][0], offsets[i][1]) && integration(x + offsets[i][0], y + offsets[i][1]) < best)
+                    {
+                        best = integration(x + offsets[i][0], y + offsets[i][1]);
+                        direction = i;
+                    }
+                }
+                directions(x, y) = direction;
+            }
+        }
+    };
+    if (parallel)
+        ThreadPool::getDefault().parallelFor(costs.height(), buildRows, minParallelRows);
+    else
+        buildRows(0, costs.height());
+}
+
+}
@@ -0,0 +1,96 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/ai/flowfieldcache.h"
+#include <algorithm>
+
+namespace ng
+{
+
+FlowFieldCache::FlowFieldCache(unsigned capacity):
+    capacity(std::max(1u, capacity)),
+    parallel(false)
+{
+}
+
+void FlowFieldCache::setGrid(const Matrix<unsigned>& costs)
+{
+    this->costs = costs;
+    clear();
+}
+
+void FlowFieldCache::setCost(unsigned x, unsigned y, unsigned cost)
+{
+    if (x < costs.width() && y < costs.height() && costs(x, y) != cost)
+    {
+        costs(x, y) = cost;
+        clear();
+    }
+}
+
+unsigned FlowFieldCache::getCost(unsigned x, unsigned y) const
+{
+    return (x < costs.width() && y < costs.height() ? costs(x, y) : 0);
+}
+
+void FlowFieldCache::setCapacity(unsigned capacity)
+{
+    this->capacity = std::max(1u, capacity);
+    evict();
+}
+
+void FlowFieldCache::setParallel(bool parallel)
+{
+    this->parallel = parallel;
+}
+
+FlowFieldCache::FieldPtr FlowFieldCache::get(const sf::Vector2u& goal)
+{
+    std::uint64_t key = getKey(goal);
+    auto found = fieldIndexes.find(key);
+    if (found != fieldIndexes.end())
+    {
+        // Move the field to the front, since it was just used
+        fields.splice(fields.begin(), fields, found->second);
+        return found->second->second;
+    }
+
+    auto field = std::make_shared<FlowField>();
+    field->build(costs, goal, parallel);
+    fields.emplace_front(key, field);
+    fieldIndexes[key] = fields.begin();
+    evict();
+    return field;
+}
+
+bool FlowFieldCache::contains(const sf::Vector2u& goal) const
+{
+    return (fieldIndexes.find(getKey(goal)) != fieldIndexes.end());
+}
+
+void FlowFieldCache::clear()
+{
+    fields.clear();
+    fieldIndexes.clear();
+}
+
+unsigned FlowFieldCache::getFieldCount() const
+{
+    return fields.size();
+}
+
+std::uint64_t FlowFieldCache::getKey(const sf::Vector2u& goal)
+{
+    return (static_cast<std::uint64_t>(goal.y) << 32) | goal.x;
+}
+
+void FlowFieldCache::evict()
+{
+    while (fields.size() > capacity)
+    {
+        fieldIndexes.erase(fields.back().first);
+        fields.pop_back();
+    }
+}
+
+}
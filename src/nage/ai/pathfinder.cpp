@@ -0,0 +1,607 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/ai/pathfinder.h"
+#include <queue>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <cmath>
+
+namespace ng
+{
+
+const unsigned Pathfinder::noCell = static_cast<unsigned>(-1);
+
+// Costs of cells that can't be reached
+static const float unreachable = std::numeric_limits<float>::infinity();
+
+static const float diagonalCost = 1.41421356f;
+
+// Runs of open cells on a border longer than this get a transition at each end instead of the middle
+static const unsigned maxSingleTransition = 5;
+
+// Open list entries for the searches, ordered by lowest estimated cost first
+using OpenEntry = std::pair<float, unsigned>;
+using OpenList = std::priority_queue<OpenEntry, std::vector<OpenEntry>, std::greater<OpenEntry>>;
+
+Pathfinder::Pathfinder(unsigned clusterSize):
+    clusterSize(std::max(1u, clusterSize))
+{
+}
+
+void Pathfinder::setGrid(const Matrix<unsigned>& costs)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    this->costs = costs;
+    build();
+}
+
+void Pathfinder::setGrid(const TileMap& tileMap, TileMap::LayerHandle layer, std::uint32_t blocking)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    const sf::Vector2u& mapSize = tileMap.getMapSize();
+    costs.resize(mapSize.x, mapSize.y, false);
+    for (unsigned y = 0; y < mapSize.y; ++y)
+    {
+        for (unsigned x = 0; x < mapSize.x; ++x)
+            costs(x, y) = (tileMap.hasProperties(layer, x, y, blocking) ? 0 : 1);
+    }
+    build();
+}
+
+void Pathfinder::setCost(unsigned x, unsigned y, unsigned cost)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    if (x < costs.width() && y < costs.height() && costs(x, y) != cost)
+    {
+        costs(x, y) = cost;
+        unsigned cluster = getCluster(y * costs.width() + x);
+        if (!dirty[cluster])
+        {
+            dirty[cluster] = true;
+            dirtyClusters.push_back(cluster);
+        }
+    }
+}
+
+unsigned Pathfinder::getCost(unsigned x, unsigned y) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    return (x < costs.width() && y < costs.height() ? costs(x, y) : 0);
+}
+
+void Pathfinder::update()
+{
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    std::vector<bool> changed(clusters.size());
+    std::vector<unsigned> changedClusters;
+    auto markChanged = [&](unsigned clusterX, unsigned clusterY)
+    {
+        unsigned cluster = clusterX + clusterY * clusterCount.x;
+        if (!changed[cluster])
+        {
+            changed[cluster] = true;
+            changedClusters.push_back(cluster);
+        }
+    };
+
+    // The borders on every side of a dirty cluster can change, which changes the nodes of its neighbors
+    for (unsigned cluster: dirtyClusters)
+    {
+        unsigned clusterX = cluster % clusterCount.x;
+        unsigned clusterY = cluster / clusterCount.x;
+        buildBorder(clusterX, clusterY, true);
+        buildBorder(clusterX, clusterY, false);
+        markChanged(clusterX, clusterY);
+        if (clusterX > 0)
+        {
+            buildBorder(clusterX - 1, clusterY, true);
+            markChanged(clusterX - 1, clusterY);
+        }
+        if (clusterY > 0)
+        {
+            buildBorder(clusterX, clusterY - 1, false);
+            markChanged(clusterX, clusterY - 1);
+        }
+        if (clusterX + 1 < clusterCount.x)
+            markChanged(clusterX + 1, clusterY);
+        if (clusterY + 1 < clusterCount.y)
+            markChanged(clusterX, clusterY + 1);
+        dirty[cluster] = false;
+    }
+    dirtyClusters.clear();
+    for (unsigned cluster: changedClusters)
+        buildNodes(cluster % clusterCount.x, cluster / clusterCount.x);
+}
+
+bool Pathfinder::findPath(const sf::Vector2u& start, const sf::Vector2u& goal, std::vector<sf::Vector2u>& path, bool smooth) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    path.clear();
+    if (start.x >= costs.width() || start.y >= costs.height() || goal.x >= costs.width() || goal.y >= costs.height() ||
+        !costs(start.x, start.y) || !costs(goal.x, goal.y))
+        return false;
+
+    unsigned width = costs.width();
+    unsigned startCell = start.y * width + start.x;
+    unsigned goalCell = goal.y * width + goal.x;
+    std::vector<unsigned> cells(1, startCell);
+    if (startCell != goalCell && !searchAbstract(startCell, goalCell, cells))
+        return false;
+    if (smooth)
+        smoothPath(cells);
+    path.reserve(cells.size());
+    for (unsigned cell: cells)
+        path.emplace_back(cell % width, cell / width);
+    return true;
+}
+
+unsigned Pathfinder::getNodeCount() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    return nodeIndexes.size();
+}
+
+void Pathfinder::build()
+{
+    clusterCount.x = (costs.width() + clusterSize - 1) / clusterSize;
+    clusterCount.y = (costs.height() + clusterSize - 1) / clusterSize;
+    clusters.clear();
+    clusters.resize(clusterCount.x * clusterCount.y);
+    nodeIndexes.clear();
+    dirty.assign(clusters.size(), false);
+    dirtyClusters.clear();
+    for (unsigned clusterY = 0; clusterY < clusterCount.y; ++clusterY)
+    {
+        for (unsigned clusterX = 0; clusterX < clusterCount.x; ++clusterX)
+        {
+            buildBorder(clusterX, clusterY, true);
+            buildBorder(clusterX, clusterY, false);
+        }
+    }
+    for (unsigned clusterY = 0; clusterY < clusterCount.y; ++clusterY)
+    {
+        for (unsigned clusterX = 0; clusterX < clusterCount.x; ++clusterX)
+            buildNodes(clusterX, clusterY);
+    }
+}
+
+void Pathfinder::buildBorder(unsigned clusterX, unsigned clusterY, bool east)
+{
+    unsigned cluster = clusterX + clusterY * clusterCount.x;
+    std::vector<Transition>& transitions = (east ? clusters[cluster].east : clusters[cluster].south);
+    transitions.clear();
+    if ((east && clusterX + 1 >= clusterCount.x) || (!east && clusterY + 1 >= clusterCount.y))
+        return;
+
+    // Returns the cells on both sides of a position along the border
+    Area area = getClusterArea(cluster);
+    unsigned width = costs.width();
+    unsigned length = (east ? area.height : area.width);
+    auto getCells = [&](unsigned i, unsigned& first, unsigned& second)
+    {
+        if (east)
+        {
+            first = (area.y + i) * width + area.x + area.width - 1;
+            second = first + 1;
+        }
+        else
+        {
+            first = (area.y + area.height - 1) * width + area.x + i;
+            second = first + width;
+        }
+    };
+    auto addTransition = [&](unsigned i)
+    {
+        unsigned first, second;
+        getCells(i, first, second);
+        transitions.push_back(Transition{first, second, getStepCost(first, second)});
+    };
+
+    // Find the runs of positions that are open on both sides
+    unsigned runStart = 0;
+    bool inRun = false;
+    for (unsigned i = 0; i <= length; ++i)
+    {
+        bool open = false;
+        if (i < length)
+        {
+            unsigned first, second;
+            getCells(i, first, second);
+            open = (getCellCost(first) && getCellCost(second));
+        }
+        if (open && !inRun)
+        {
+            runStart = i;
+            inRun = true;
+        }
+        else if (!open && inRun)
+        {
+            // Short runs get a transition in the middle, and long runs get one at each end
+            inRun = false;
+            unsigned runLength = i - runStart;
+            if (runLength <= maxSingleTransition)
+                addTransition(runStart + runLength / 2);
+            else
+            {
+                addTransition(runStart);
+                addTransition(i - 1);
+            }
+        }
+    }
+}
+
+void Pathfinder::buildNodes(unsigned clusterX, unsigned clusterY)
+{
+    unsigned cluster = clusterX + clusterY * clusterCount.x;
+    Cluster& current = clusters[cluster];
+    for (unsigned cell: current.nodes)
+        nodeIndexes.erase(cell);
+    current.nodes.clear();
+
+    // The nodes are the cells of this cluster on all four borders
+    auto addNode = [&](unsigned cell)
+    {
+        if (std::find(current.nodes.begin(), current.nodes.end(), cell) == current.nodes.end())
+            current.nodes.push_back(cell);
+    };
+    for (auto& transition: current.east)
+        addNode(transition.cellA);
+    for (auto& transition: current.south)
+        addNode(transition.cellA);
+    if (clusterX > 0)
+    {
+        for (auto& transition: clusters[cluster - 1].east)
+            addNode(transition.cellB);
+    }
+    if (clusterY > 0)
+    {
+        for (auto& transition: clusters[cluster - clusterCount.x].south)
+            addNode(transition.cellB);
+    }
+
+    // Find the costs between every pair of nodes, staying inside of the cluster
+    unsigned count = current.nodes.size();
+    current.distances.assign(count * count, unreachable);
+    Area area = getClusterArea(cluster);
+    unsigned width = costs.width();
+    std::vector<float> pathCosts;
+    std::vector<unsigned> parents;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        nodeIndexes[current.nodes[i]] = i;
+        search(area, current.nodes[i], noCell, pathCosts, parents);
+        for (unsigned j = 0; j < count; ++j)
+        {
+            unsigned cell = current.nodes[j];
+            current.distances[i * count + j] = pathCosts[(cell / width - area.y) * area.width + (cell % width - area.x)];
+        }
+    }
+}
+
+void Pathfinder::search(const Area& area, unsigned start, unsigned goal, std::vector<float>& costs, std::vector<unsigned>& parents) const
+{
+    unsigned width = this->costs.width();
+    unsigned size = area.width * area.height;
+    costs.assign(size, unreachable);
+    parents.assign(size, noCell);
+    std::vector<bool> closed(size);
+    auto getLocal = [&](unsigned x, unsigned y){ return (y - area.y) * area.width + (x - area.x); };
+
+    OpenList open;
+    unsigned startLocal = getLocal(start % width, start / width);
+    costs[startLocal] = 0;
+    open.emplace((goal != noCell ? getHeuristic(start, goal) : 0), startLocal);
+    while (!open.empty())
+    {
+        unsigned local = open.top().second;
+        open.pop();
+        if (closed[local])
+            continue;
+        closed[local] = true;
+        unsigned x = area.x + local % area.width;
+        unsigned y = area.y + local / area.width;
+        unsigned cell = y * width + x;
+        if (cell == goal)
+            return;
+
+        for (int dy = -1; dy <= 1; ++dy)
+        {
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+                int nextX = static_cast<int>(x) + dx;
+                int nextY = static_cast<int>(y) + dy;
+                if ((dx == 0 && dy == 0) || nextX < static_cast<int>(area.x) || nextY < static_cast<int>(area.y) ||
+                    nextX >= static_cast<int>(area.x + area.width) || nextY >= static_cast<int>(area.y + area.height) ||
+                    !canStep(x, y, dx, dy))
+                    continue;
+                unsigned nextCell = nextY * width + nextX;
+                unsigned nextLocal = getLocal(nextX, nextY);
+                float cost = costs[local] + getStepCost(cell, nextCell);
+                if (cost < costs[nextLocal])
+                {
+                    costs[nextLocal] = cost;
+                    parents[nextLocal] = local;
+                    open.emplace(cost + (goal != noCell ? getHeuristic(nextCell, goal) : 0), nextLocal);
+                }
+            }
+        }
+    }
+}
+
+bool Pathfinder::searchPath(const Area& area, unsigned start, unsigned goal, std::vector<unsigned>& path) const
+{
+    std::vector<float> pathCosts;
+    std::vector<unsigned> parents;
+    search(area, start, goal, pathCosts, parents);
+    unsigned width = costs.width();
+    unsigned goalLocal = (goal / width - area.y) * area.width + (goal % width - area.x);
+    if (pathCosts[goalLocal] == unreachable)
+        return false;
+
+    // Follow the parents back to the start, and append the cells in order
+    std::size_t first = path.size();
+    for (unsigned local = goalLocal; parents[local] != noCell; local = parents[local])
+        path.push_back((area.y + local / area.width) * width + area.x + local % area.width);
+    std::reverse(path.begin() + first, path.end());
+    return true;
+}
+
+bool Pathfinder::searchAbstract(unsigned start, unsigned goal, std::vector<unsigned>& path) const
+{
+    // Connect the start and goal to the nodes of their clusters
+    unsigned width = costs.width();
+    unsigned startCluster = getCluster(start);
+    unsigned goalCluster = getCluster(goal);
+    Area startArea = getClusterArea(startCluster);
+    Area goalArea = getClusterArea(goalCluster);
+    std::vector<float> startCosts, goalCosts;
+    std::vector<unsigned> parents;
+    search(startArea, start, noCell, startCosts, parents);
+    search(goalArea, goal, noCell, goalCosts, parents);
+    auto getLocal = [width](const Area& area, unsigned cell)
+    {
+        return (cell / width - area.y) * area.width + (cell % width - area.x);
+    };
+
+    // Run A* over the nodes, where the start and goal are extra nodes
+    struct Record
+    {
+        float cost;
+        unsigned parent;
+        bool closed;
+    };
+    std::unordered_map<unsigned, Record> records;
+    records[start] = Record{0, noCell, false};
+    OpenList open;
+    open.emplace(getHeuristic(start, goal), start);
+    std::vector<std::pair<unsigned, float>> neighbors;
+    bool found = false;
+    while (!open.empty() && !found)
+    {
+        unsigned cell = open.top().second;
+        open.pop();
+        Record& record = records[cell];
+        if (record.closed)
+            continue;
+        record.closed = true;
+        float cost = record.cost;
+        if (cell == goal)
+        {
+            found = true;
+            break;
+        }
+
+        neighbors.clear();
+        unsigned cluster = getCluster(cell);
+        if (cell == start)
+        {
+            for (unsigned node: clusters[startCluster].nodes)
+                neighbors.emplace_back(node, startCosts[getLocal(startArea, node)]);
+        }
+        auto nodeIndex = nodeIndexes.find(cell);
+        if (nodeIndex != nodeIndexes.end())
+        {
+            const Cluster& current = clusters[cluster];
+            unsigned count = current.nodes.size();
+            for (unsigned j = 0; j < count; ++j)
+            {
+                if (j != nodeIndex->second)
+                    neighbors.emplace_back(current.nodes[j], current.distances[nodeIndex->second * count + j]);
+            }
+            getTransitions(cluster, cell, neighbors);
+        }
+        if (cluster == goalCluster)
+            neighbors.emplace_back(goal, goalCosts[getLocal(goalArea, cell)]);
+
+        for (auto& neighbor: neighbors)
+        {
+            if (neighbor.second == unreachable)
+                continue;
+            float nextCost = cost + neighbor.second;
+            auto next = records.find(neighbor.first);
+            if (next == records.end())
+                next = records.emplace(neighbor.first, Record{unreachable, noCell, false}).first;
+            if (!next->second.closed && nextCost < next->second.cost)
+            {
+                next->second.cost = nextCost;
+                next->second.parent = cell;
+                open.emplace(nextCost + getHeuristic(neighbor.first, goal), neighbor.first);
+            }
+        }
+    }
+    if (!found)
+        return false;
+
+    // Get the abstract path, and refine each step into cells
+    std::vector<unsigned> abstractPath;
+    for (unsigned cell = goal; cell != noCell; cell = records[cell].parent)
+        abstractPath.push_back(cell);
+    std::reverse(abstractPath.begin(), abstractPath.end());
+    for (unsigned i = 1; i < abstractPath.size(); ++i)
+    {
+        unsigned from = abstractPath[i - 1];
+        unsigned to = abstractPath[i];
+        unsigned cluster = getCluster(from);
+        if (cluster == getCluster(to))
+        {
+            if (!searchPath(getClusterArea(cluster), from, to, path))
+                return false;
+        }
+        else
+            path.push_back(to);
+    }
+    return true;
+}
+
+void Pathfinder::smoothPath(std::vector<unsigned>& path) const
+{
+    if (path.size() <= 2)
+        return;
+
+    // Extend a straight line from each kept cell for as long as it stays clear
+    std::vector<unsigned> smoothed(1, path.front());
+    unsigned anchor = 0;
+    while (anchor + 1 < path.size())
+    {
+        unsigned maxCost = getCellCost(path[anchor]);
+        unsigned next = anchor + 1;
+        for (unsigned i = anchor + 1; i < path.size(); ++i)
+        {
+            maxCost = std::max(maxCost, getCellCost(path[i]));
+            if (i > anchor + 1 && !isLineClear(path[anchor], path[i], maxCost))
+                break;
+            next = i;
+        }
+        smoothed.push_back(path[next]);
+        anchor = next;
+    }
+    path.swap(smoothed);
+}
+
+bool Pathfinder::isLineClear(unsigned from, unsigned to, unsigned maxCost) const
+{
+    unsigned width = costs.width();
+    int x = from % width;
+    int y = from / width;
+    int dx = static_cast<int>(to % width) - x;
+    int dy = static_cast<int>(to / width) - y;
+    int stepX = (dx > 0 ? 1 : -1);
+    int stepY = (dy > 0 ? 1 : -1);
+    int countX = std::abs(dx);
+    int countY = std::abs(dy);
+    auto isClear = [&](int cellX, int cellY)
+    {
+        unsigned cost = costs(cellX, cellY);
+        return (cost && cost <= maxCost);
+    };
+
+    // Visit every cell the line touches, including both cells when it passes exactly through a corner
+    for (int i = 0, j = 0; i < countX || j < countY; )
+    {
+        int decision = (1 + 2 * i) * countY - (1 + 2 * j) * countX;
+        if (decision == 0)
+        {
+            if (!isClear(x + stepX, y) || !isClear(x, y + stepY))
+                return false;
+            x += stepX;
+            y += stepY;
+            ++i;
+            ++j;
+        }
+        else if (decision < 0)
+        {
+            x += stepX;
+            ++i;
+        }
+        else
+        {
+            y += stepY;
+            ++j;
+        }
+        if (!isClear(x, y))
+            return false;
+    }
+    return true;
+}
+
+unsigned Pathfinder::getCellCost(unsigned cell) const
+{
+    return costs(cell % costs.width(), cell / costs.width());
+}
+
+float Pathfinder::getStepCost(unsigned from, unsigned to) const
+{
+    unsigned width = costs.width();
+    float cost = (getCellCost(from) + getCellCost(to)) * 0.5f;
+    if (from % width != to % width && from / width != to / width)
+        cost *= diagonalCost;
+    return cost;
+}
+
+bool Pathfinder::canStep(unsigned x, unsigned y, int dx, int dy) const
+{
+    int nextX = static_cast<int>(x) + dx;
+    int nextY = static_cast<int>(y) + dy;
+    if (nextX < 0 || nextY < 0 || nextX >= static_cast<int>(costs.width()) || nextY >= static_cast<int>(costs.height()) ||
+        !costs(nextX, nextY))
+        return false;
+    return (dx == 0 || dy == 0 || (costs(nextX, y) && costs(x, nextY)));
+}
+
+float Pathfinder::getHeuristic(unsigned from, unsigned to) const
+{
+    // Octile distance, since every walkable cell costs at least 1
+    unsigned width = costs.width();
+    float dx = std::abs(static_cast<int>(from % width) - static_cast<int>(to % width));
+    float dy = std::abs(static_cast<int>(from / width) - static_cast<int>(to / width));
+    return std::max(dx, dy) + (diagonalCost - 1) * std::min(dx, dy);
+}
+
+Pathfinder::Area Pathfinder::getClusterArea(unsigned cluster) const
+{
+    unsigned x = (cluster % clusterCount.x) * clusterSize;
+    unsigned y = (cluster / clusterCount.x) * clusterSize;
+    return Area{x, y, std::min(clusterSize, costs.width() - x), std::min(clusterSize, costs.height() - y)};
+}
+
+unsigned Pathfinder::getCluster(unsigned cell) const
+{
+    unsigned width = costs.width();
+    return (cell % width) / clusterSize + (cell / width) / clusterSize * clusterCount.x;
+}
+
+void Pathfinder::getTransitions(unsigned cluster, unsigned cell, std::vector<std::pair<unsigned, float>>& neighbors) const
+{
+    const Cluster& current = clusters[cluster];
+    for (auto& transition: current.east)
+    {
+        if (transition.cellA == cell)
+            neighbors.emplace_back(transition.cellB, transition.cost);
+    }
+    for (auto& transition: current.south)
+    {
+        if (transition.cellA == cell)
+            neighbors.emplace_back(transition.cellB, transition.cost);
+    }
+    if (cluster % clusterCount.x > 0)
+    {
+        for (auto& transition: clusters[cluster - 1].east)
+        {
+            if (transition.cellB == cell)
+                neighbors.emplace_back(transition.cellA, transition.cost);
+        }
+    }
+    if (cluster >= clusterCount.x)
+    {
+        for (auto& transition: clusters[cluster - clusterCount.x].south)
+        {
+            if (transition.cellB == cell)
+                neighbors.emplace_back(transition.cellA, transition.cost);
+        }
+    }
+}
+
+}
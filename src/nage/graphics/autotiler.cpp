@@ -0,0 +1,229 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/graphics/autotiler.h"
+#include "nage/graphics/tilejournal.h"
+#include <configfile.h>
+#include <iostream>
+#include <array>
+#include <algorithm>
+
+namespace ng
+{
+
+const unsigned AutoTiler::blobTiles;
+
+AutoTiler::AutoTiler(TileMap& tileMap, int layer):
+    tileMap(tileMap),
+    layer(tileMap.getLayer(layer)),
+    layerId(layer),
+    journal(nullptr)
+{
+    resize();
+}
+
+void AutoTiler::setJournal(TileJournal* journal)
+{
+    this->journal = journal;
+}
+
+bool AutoTiler::loadFromConfig(const std::string& filename)
+{
+    cfg::File config(filename);
+    if (!config)
+        return false;
+    bool status = true;
+    for (auto& section: config)
+    {
+        if (!section.first.empty())
+        {
+            config.useSection(section.first);
+            std::vector<unsigned> tiles;
+            for (auto& option: config("tiles"))
+                tiles.push_back(option.toInt());
+            status = addTerrain(config("terrain").toInt(), tiles) && status;
+        }
+    }
+    config.useSection("");
+    return status;
+}
+
+bool AutoTiler::addTerrain(unsigned terrain, const std::vector<unsigned>& tiles)
+{
+    if (terrain == 0)
+    {
+        std::cerr << "Error: Terrain 0 is reserved for empty cells.\n";
+        return false;
+    }
+    if (tiles.size() != blobTiles)
+    {
+        std::cerr << "Error: Terrain " << terrain << " has " << tiles.size() << " tiles instead of " << blobTiles << ".\n";
+        return false;
+    }
+    if (terrain >= terrainTiles.size())
+        terrainTiles.resize(terrain + 1);
+    terrainTiles[terrain] = tiles;
+    return true;
+}
+
+void AutoTiler::paint(unsigned x, unsigned y, unsigned terrain)
+{
+    resize();
+    if (x < terrains.width() && y < terrains.height())
+    {
+        setTerrain(x, y, terrain);
+        flush();
+    }
+}
+
+void AutoTiler::paintRegion(unsigned x, unsigned y, unsigned width, unsigned height, unsigned terrain)
+{
+    resize();
+    unsigned endX = std::min(x + width, terrains.width());
+    unsigned endY = std::min(y + height, terrains.height());
+    for (unsigned cellY = y; cellY < endY; ++cellY)
+    {
+        for (unsigned cellX = x; cellX < endX; ++cellX)
+            setTerrain(cellX, cellY, terrain);
+    }
+    flush();
+}
+
+void AutoTiler::paintCells(const std::vector<sf::Vector2u>& cells, unsigned terrain)
+{
+    resize();
+    for (auto& cell: cells)
+    {
+        if (cell.x < terrains.width() && cell.y < terrains.height())
+            setTerrain(cell.x, cell.y, terrain);
+    }
+    flush();
+}
+
+unsigned AutoTiler::getTerrain(unsigned x, unsigned y) const
+{
+    if (x < terrains.width() && y < terrains.height())
+        return terrains(x, y);
+    return 0;
+}
+
+unsigned AutoTiler::getBlobIndex(unsigned neighbors)
+{
+    // Build a table from every mask to its index, where the indexes are in order of the reduced masks
+    static const std::array<unsigned char, 256> indexes = []
+    {
+        std::array<unsigned char, 256> table;
+        std::array<bool, 256> valid{};
+        auto reduce = [](unsigned mask)
+        {
+            if (!(mask & North) || !(mask & East))
+                mask &= ~NorthEast;
+            if (!(mask & South) || !(mask & East))
+                mask &= ~SouthEast;
+            if (!(mask & South) || !(mask & West))
+                mask &= ~SouthWest;
+            if (!(mask & North) || !(mask & West))
+                mask &= ~NorthWest;
+            return mask;
+        };
+        for (unsigned mask = 0; mask < 256; ++mask)
+            valid[reduce(mask)] = true;
+        std::array<unsigned char, 256> ranks{};
+        unsigned char rank = 0;
+        for (unsigned mask = 0; mask < 256; ++mask)
+        {
+            if (valid[mask])
+                ranks[mask] = rank++;
+        }
+        for (unsigned mask = 0; mask < 256; ++mask)
+            table[mask] = ranks[reduce(mask)];
+        return table;
+    }();
+    return indexes[neighbors & 0xFF];
+}
+
+void AutoTiler::resize()
+{
+    const sf::Vector2u& mapSize = tileMap.getMapSize();
+    if (terrains.width() != mapSize.x || terrains.height() != mapSize.y)
+    {
+        terrains.resize(mapSize.x, mapSize.y, false);
+        dirty.resize(mapSize.x, mapSize.y);
+        dirtyCells.clear();
+    }
+}
+
+void AutoTiler::setTerrain(unsigned x, unsigned y, unsigned terrain)
+{
+    if (terrains(x, y) == terrain)
+        return;
+    terrains(x, y) = terrain;
+
+    // Only the cell and its neighbors can change
+    unsigned startX = (x > 0 ? x - 1 : 0);
+    unsigned startY = (y > 0 ? y - 1 : 0);
+    unsigned endX = std::min(x + 2, terrains.width());
+    unsigned endY = std::min(y + 2, terrains.height());
+    for (unsigned cellY = startY; cellY < endY; ++cellY)
+    {
+        for (unsigned cellX = startX; cellX < endX; ++cellX)
+        {
+            if (!dirty.get(cellX, cellY))
+            {
+                dirty.set(cellX, cellY, true);
+                dirtyCells.emplace_back(cellX, cellY);
+            }
+        }
+    }
+}
+
+void AutoTiler::flush()
+{
+    for (auto& cell: dirtyCells)
+    {
+        unsigned terrain = terrains(cell.x, cell.y);
+        unsigned value = 0;
+        if (terrain < terrainTiles.size() && !terrainTiles[terrain].empty())
+            value = terrainTiles[terrain][getBlobIndex(getNeighbors(cell.x, cell.y))];
+        if (journal)
+            journal->set(layerId, cell.x, cell.y, value);
+        else
+            tileMap.set(layer, cell.x, cell.y, value);
+        dirty.set(cell.x, cell.y, false);
+    }
+    dirtyCells.clear();
+}
+
+unsigned AutoTiler::getNeighbors(unsigned x, unsigned y) const
+{
+    unsigned terrain = terrains(x, y);
+    int cellX = x;
+    int cellY = y;
+    unsigned neighbors = 0;
+    if (matches(cellX, cellY - 1, terrain))
+        neighbors |= North;
+    if (matches(cellX + 1, cellY - 1, terrain))
+        neighbors |= NorthEast;
+    if (matches(cellX + 1, cellY, terrain))
+        neighbors |= East;
+    if (matches(cellX + 1, cellY + 1, terrain))
+        neighbors |= SouthEast;
+    if (matches(cellX, cellY + 1, terrain))
+        neighbors |= South;
+    if (matches(cellX - 1, cellY + 1, terrain))
+        neighbors |= SouthWest;
+    if (matches(cellX - 1, cellY, terrain))
+        neighbors |= West;
+    if (matches(cellX - 1, cellY - 1, terrain))
+        neighbors |= NorthWest;
+    return neighbors;
+}
+
+bool AutoTiler::matches(int x, int y, unsigned terrain) const
+{
+    if (x < 0 || y < 0 || x >= static_cast<int>(terrains.width()) || y >= static_cast<int>(terrains.height()))
+        return true;
+    return (terrains(x, y) == terrain);
+}
+
+}
@@ -0,0 +1,105 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/graphics/fogofwar.h"
+
+namespace ng
+{
+
+FogOfWar::FogOfWar(TileMap& tileMap, TileMap::LayerHandle layer):
+    tileMap(tileMap),
+    layer(layer),
+    hiddenColor(sf::Color::Black),
+    exploredColor(128, 128, 128),
+    visibleColor(sf::Color::White),
+    changedCount(0)
+{
+    checkSize();
+    refresh();
+}
+
+void FogOfWar::setColors(const sf::Color& hidden, const sf::Color& explored, const sf::Color& visible)
+{
+    hiddenColor = hidden;
+    exploredColor = explored;
+    visibleColor = visible;
+    refresh();
+}
+
+void FogOfWar::update(const BitMatrix& visible)
+{
+    checkSize();
+    changedCount = 0;
+    if (visible.width() != visibleCells.width() || visible.height() != visibleCells.height())
+        return;
+
+    // Find the cells that became visible or stopped being visible
+    changedCells = visible;
+    changedCells.toggle(visibleCells);
+    visibleCells = visible;
+    exploredCells.merge(visible);
+    unsigned width = visibleCells.width();
+    for (unsigned y = 0; y < visibleCells.height(); ++y)
+    {
+        for (unsigned x = changedCells.findInRow(y, 0, width); x < width; x = changedCells.findInRow(y, x + 1, width))
+        {
+            applyColor(x, y);
+            ++changedCount;
+        }
+    }
+}
+
+void FogOfWar::reset()
+{
+    checkSize();
+    visibleCells.fill(false);
+    exploredCells.fill(false);
+    refresh();
+}
+
+void FogOfWar::refresh()
+{
+    checkSize();
+    for (unsigned y = 0; y < visibleCells.height(); ++y)
+    {
+        for (unsigned x = 0; x < visibleCells.width(); ++x)
+            applyColor(x, y);
+    }
+}
+
+bool FogOfWar::isVisible(unsigned x, unsigned y) const
+{
+    return (x < visibleCells.width() && y < visibleCells.height() && visibleCells.get(x, y));
+}
+
+bool FogOfWar::isExplored(unsigned x, unsigned y) const
+{
+    return (x < exploredCells.width() && y < exploredCells.height() && exploredCells.get(x, y));
+}
+
+unsigned FogOfWar::getChangedCount() const
+{
+    return changedCount;
+}
+
+void FogOfWar::checkSize()
+{
+    const sf::Vector2u& mapSize = tileMap.getMapSize();
+    if (visibleCells.width() != mapSize.x || visibleCells.height() != mapSize.y)
+    {
+        visibleCells.resize(mapSize.x, mapSize.y);
+        exploredCells.resize(mapSize.x, mapSize.y);
+    }
+}
+
+void FogOfWar::applyColor(unsigned x, unsigned y)
+{
+    if (visibleCells.get(x, y))
+        tileMap.setTileColor(layer, x, y, visibleColor);
+    else if (exploredCells.get(x, y))
+        tileMap.setTileColor(layer, x, y, exploredColor);
+    else
+        tileMap.setTileColor(layer, x, y, hiddenColor);
+}
+
+}
@@ -0,0 +1,344 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/graphics/streamedtilemap.h"
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "nage/graphics/tilemap.h"
+#include "nage/graphics/views.h"
+
+namespace ng
+{
+
+/*
+Chunk file format (all values are 32-bit integers in native byte order):
+    Header: magic ("NGTC"), version, chunk size, layer count
+    Layer data: chunk size * chunk size tile IDs for each layer
+*/
+static const char chunkMagic[4] = {'N', 'G', 'T', 'C'};
+static const std::uint32_t chunkVersion = 1;
+static const unsigned chunkSize = TileMap::chunkSize;
+static const unsigned chunkTiles = chunkSize * chunkSize;
+
+// Divides and rounds towards negative infinity, so negative coordinates map to the correct chunk
+static int floorDiv(int numerator, int denominator)
+{
+    int quotient = numerator / denominator;
+    if ((numerator % denominator != 0) && ((numerator < 0) != (denominator < 0)))
+        --quotient;
+    return quotient;
+}
+
+StreamedTileMap::StreamedTileMap():
+    radius(2),
+    running(false)
+{
+}
+
+StreamedTileMap::~StreamedTileMap()
+{
+    stopThread();
+}
+
+bool StreamedTileMap::loadTileset(const std::string& filename, unsigned tileWidth, unsigned tileHeight, unsigned types, unsigned padding)
+{
+    return tileset.loadFromFile(filename, tileWidth, tileHeight, types, padding);
+}
+
+void StreamedTileMap::setWorld(const std::string& directory)
+{
+    stopThread();
+    chunks.clear();
+    pending.clear();
+    requests.clear();
+    finished.clear();
+    worldDirectory = directory;
+    startThread();
+}
+
+void StreamedTileMap::setRadius(unsigned radius)
+{
+    this->radius = radius;
+}
+
+void StreamedTileMap::setFocus(const sf::Vector2f& center)
+{
+    const sf::Vector2u& tileSize = tileset.getTileSize();
+    if (tileSize.x > 0 && tileSize.y > 0)
+    {
+        focusChunk.x = static_cast<int>(std::floor(center.x / (chunkSize * tileSize.x)));
+        focusChunk.y = static_cast<int>(std::floor(center.y / (chunkSize * tileSize.y)));
+    }
+}
+
+void StreamedTileMap::update()
+{
+    // Find the chunks around the focus point which aren't loaded or pending, closest first
+    std::vector<sf::Vector2i> needed;
+    int size = radius;
+    for (int y = focusChunk.y - size; y <= focusChunk.y + size; ++y)
+    {
+        for (int x = focusChunk.x - size; x <= focusChunk.x + size; ++x)
+        {
+            ChunkKey key = makeKey(x, y);
+            if (chunks.find(key) == chunks.end() && pending.find(key) == pending.end())
+                needed.emplace_back(x, y);
+        }
+    }
+    auto distance = [&](const sf::Vector2i& pos)
+    {
+        return std::max(std::abs(pos.x - focusChunk.x), std::abs(pos.y - focusChunk.y));
+    };
+    std::sort(needed.begin(), needed.end(), [&](const sf::Vector2i& a, const sf::Vector2i& b)
+    {
+        return distance(a) < distance(b);
+    });
+
+    // Only swap the queues while locked, so the background thread is never waited on for long
+    std::vector<ChunkPtr> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(finished);
+
+        // Drop requests that went out of range before they were started
+        for (auto it = requests.begin(); it != requests.end(); )
+        {
+            if (inRadius(*it))
+                ++it;
+            else
+            {
+                pending.erase(makeKey(it->x, it->y));
+                it = requests.erase(it);
+            }
+        }
+        requests.insert(requests.end(), needed.begin(), needed.end());
+        std::stable_sort(requests.begin(), requests.end(), [&](const sf::Vector2i& a, const sf::Vector2i& b)
+        {
+            return distance(a) < distance(b);
+        });
+    }
+    if (!needed.empty())
+        condition.notify_one();
+    for (auto& pos: needed)
+        pending.insert(makeKey(pos.x, pos.y));
+
+    // Keep the finished chunks which are still in range
+    for (auto& chunk: done)
+    {
+        ChunkKey key = makeKey(chunk->position.x, chunk->position.y);
+        pending.erase(key);
+        if (inRadius(chunk->position))
+            chunks[key] = std::move(chunk);
+    }
+
+    // Evict the chunks that are out of range
+    for (auto it = chunks.begin(); it != chunks.end(); )
+    {
+        if (inRadius(it->second->position))
+            ++it;
+        else
+            it = chunks.erase(it);
+    }
+}
+
+unsigned StreamedTileMap::operator()(unsigned layer, int x, int y) const
+{
+    int chunkX = floorDiv(x, chunkSize);
+    int chunkY = floorDiv(y, chunkSize);
+    auto found = chunks.find(makeKey(chunkX, chunkY));
+    if (found == chunks.end() || layer >= found->second->layers.size())
+        return 0;
+    unsigned localX = x - chunkX * static_cast<int>(chunkSize);
+    unsigned localY = y - chunkY * static_cast<int>(chunkSize);
+    return found->second->layers[layer][localX + localY * chunkSize];
+}
+
+bool StreamedTileMap::isLoaded(int chunkX, int chunkY) const
+{
+    return (chunks.find(makeKey(chunkX, chunkY)) != chunks.end());
+}
+
+unsigned StreamedTileMap::getLoadedCount() const
+{
+    return chunks.size();
+}
+
+bool StreamedTileMap::saveChunk(const std::string& directory, int chunkX, int chunkY, const std::vector<std::vector<unsigned>>& layers)
+{
+    for (auto& layer: layers)
+    {
+        if (layer.size() != chunkTiles)
+            return false;
+    }
+    std::ofstream file(getChunkFilename(directory, chunkX, chunkY), std::ios::out | std::ios::binary | std::ios::trunc);
+    std::uint32_t header[] = {chunkVersion, chunkSize, static_cast<std::uint32_t>(layers.size())};
+    file.write(chunkMagic, sizeof(chunkMagic));
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (auto& layer: layers)
+        file.write(reinterpret_cast<const char*>(layer.data()), layer.size() * sizeof(unsigned));
+    return static_cast<bool>(file);
+}
+
+void StreamedTileMap::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    const sf::Vector2u& tileSize = tileset.getTileSize();
+    if (chunks.empty() || tileSize.x == 0 || tileSize.y == 0)
+        return;
+    states.transform *= getTransform();
+    states.texture = &tileset.getTexture();
+
+    // Calculate the range of chunks that intersect the visible area
+    sf::FloatRect viewRect = states.transform.getInverse().transformRect(views::getViewRect(target.getView()));
+    float chunkWidth = chunkSize * tileSize.x;
+    float chunkHeight = chunkSize * tileSize.y;
+    int startX = std::floor(viewRect.left / chunkWidth);
+    int startY = std::floor(viewRect.top / chunkHeight);
+    int endX = std::ceil((viewRect.left + viewRect.width) / chunkWidth);
+    int endY = std::ceil((viewRect.top + viewRect.height) / chunkHeight);
+
+    // Draw layer by layer, so upper layers of a chunk cover the lower layers of its neighbors
+    std::vector<const Chunk*> visible;
+    unsigned layerCount = 0;
+    for (int y = startY; y < endY; ++y)
+    {
+        for (int x = startX; x < endX; ++x)
+        {
+            auto found = chunks.find(makeKey(x, y));
+            if (found != chunks.end())
+            {
+                visible.push_back(found->second.get());
+                layerCount = std::max<unsigned>(layerCount, found->second->vertices.size());
+            }
+        }
+    }
+    for (unsigned layer = 0; layer < layerCount; ++layer)
+    {
+        for (auto chunk: visible)
+        {
+            if (layer < chunk->vertices.size() && chunk->vertices[layer].getVertexCount() > 0)
+                target.draw(chunk->vertices[layer], states);
+        }
+    }
+}
+
+StreamedTileMap::ChunkKey StreamedTileMap::makeKey(int chunkX, int chunkY)
+{
+    return (static_cast<ChunkKey>(static_cast<std::uint32_t>(chunkX)) << 32) | static_cast<std::uint32_t>(chunkY);
+}
+
+std::string StreamedTileMap::getChunkFilename(const std::string& directory, int chunkX, int chunkY)
+{
+    return directory + "/" + std::to_string(chunkX) + "_" + std::to_string(chunkY) + ".chunk";
+}
+
+bool StreamedTileMap::inRadius(const sf::Vector2i& position) const
+{
+    return (std::abs(position.x - focusChunk.x) <= static_cast<int>(radius) &&
+            std::abs(position.y - focusChunk.y) <= static_cast<int>(radius));
+}
+
+void StreamedTileMap::startThread()
+{
+    running = true;
+    thread = std::thread(&StreamedTileMap::run, this);
+}
+
+void StreamedTileMap::stopThread()
+{
+    if (thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        condition.notify_one();
+        thread.join();
+    }
+}
+
+void StreamedTileMap::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        if (requests.empty())
+        {
+            condition.wait(lock);
+            continue;
+        }
+        sf::Vector2i position = requests.front();
+        requests.pop_front();
+
+        // The disk is only accessed while unlocked
+        lock.unlock();
+        ChunkPtr chunk = loadChunk(position);
+        lock.lock();
+        finished.push_back(std::move(chunk));
+    }
+}
+
+StreamedTileMap::ChunkPtr StreamedTileMap::loadChunk(const sf::Vector2i& position) const
+{
+    ChunkPtr chunk(new Chunk());
+    chunk->position = position;
+
+    // Missing or invalid chunk files are loaded as empty chunks
+    std::ifstream file(getChunkFilename(worldDirectory, position.x, position.y), std::ios::in | std::ios::binary);
+    char magic[4];
+    std::uint32_t header[3];
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, chunkMagic, sizeof(magic)) != 0 ||
+        !file.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        header[0] != chunkVersion || header[1] != chunkSize)
+        return chunk;
+
+    // Make sure the file has all of the layers before allocating them, so a corrupt count can't allocate too much
+    std::streamoff dataStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::streamoff dataSize = file.tellg() - dataStart;
+    file.seekg(dataStart);
+    if (dataStart < 0 || dataSize < 0 || header[2] > static_cast<std::uint64_t>(dataSize) / (chunkTiles * sizeof(unsigned)))
+        return chunk;
+    chunk->layers.resize(header[2]);
+    for (auto& layer: chunk->layers)
+    {
+        layer.resize(chunkTiles);
+        if (!file.read(reinterpret_cast<char*>(layer.data()), chunkTiles * sizeof(unsigned)))
+        {
+            chunk->layers.clear();
+            return chunk;
+        }
+    }
+
+    // Build quads for the non-empty tiles
+    const sf::Vector2u& tileSize = tileset.getTileSize();
+    sf::Vector2i origin(position.x * static_cast<int>(chunkSize), position.y * static_cast<int>(chunkSize));
+    chunk->vertices.resize(chunk->layers.size());
+    for (unsigned i = 0; i < chunk->layers.size(); ++i)
+    {
+        const std::vector<unsigned>& layer = chunk->layers[i];
+        sf::VertexArray& vertices = chunk->vertices[i];
+        vertices.setPrimitiveType(sf::Quads);
+        vertices.resize(chunkTiles * 4 - std::count(layer.begin(), layer.end(), 0u) * 4);
+        unsigned quadIndex = 0;
+        for (unsigned index = 0; index < chunkTiles; ++index)
+        {
+            if (layer[index])
+            {
+                float x = origin.x + static_cast<int>(index % chunkSize);
+                float y = origin.y + static_cast<int>(index / chunkSize);
+                sf::Vertex* quad = &vertices[quadIndex * 4];
+                quad[0].position = sf::Vector2f(x * tileSize.x, y * tileSize.y);
+                quad[1].position = sf::Vector2f((x + 1) * tileSize.x, y * tileSize.y);
+                quad[2].position = sf::Vector2f((x + 1) * tileSize.x, (y + 1) * tileSize.y);
+                quad[3].position = sf::Vector2f(x * tileSize.x, (y + 1) * tileSize.y);
+                tileset.setTexCoords(quad, layer[index]);
+                ++quadIndex;
+            }
+        }
+    }
+    return chunk;
+}
+
+}
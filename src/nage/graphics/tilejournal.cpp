@@ -0,0 +1,453 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/graphics/tilejournal.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+namespace ng
+{
+
+/*
+Journal file format:
+    Header: magic ("NGTJ"), version, map width, map height (32-bit integers in native byte order)
+    Actions: the size of the action in bytes, followed by its runs
+    Runs: layer ID, cell offset from the end of the previous run, cell count, old ID, new ID
+All of the values after the header are variable length integers, with 7 bits per byte and the
+    high bit set on every byte but the last. The layer ID and cell offset are zigzag encoded,
+    since they can be negative.
+Version 1 files didn't have the map size, so it isn't checked when they are replayed.
+*/
+static const char journalMagic[4] = {'N', 'G', 'T', 'J'};
+static const std::uint32_t journalVersion = 2;
+static const unsigned defaultHistoryLimit = 1000;
+
+static void writeVarint(std::vector<std::uint8_t>& data, std::uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        data.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back(static_cast<std::uint8_t>(value));
+}
+
+static bool readVarint(const std::uint8_t* data, std::size_t size, std::size_t& offset, std::uint32_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 35 && offset < size; shift += 7)
+    {
+        std::uint8_t byte = data[offset++];
+        value |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static std::uint32_t zigzagEncode(std::int32_t value)
+{
+    return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+}
+
+static std::int32_t zigzagDecode(std::uint32_t value)
+{
+    return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1);
+}
+
+// Checks the header of a journal file, and returns the offset of the first action (0 if it can't be used with the map)
+// Cells are stored as indexes, so the actions would change the wrong tiles of a map with a different size
+static std::size_t checkHeader(const std::uint8_t* data, std::size_t size, const TileMap& tileMap, const std::string& filename)
+{
+    std::uint32_t header[3];
+    if (size < sizeof(journalMagic) + sizeof(header[0]) || std::memcmp(data, journalMagic, sizeof(journalMagic)) != 0)
+    {
+        std::cerr << "Error: " << filename << " is not a tile journal file.\n";
+        return 0;
+    }
+    std::memcpy(header, data + sizeof(journalMagic), sizeof(header[0]));
+    if (header[0] == 1)
+        return sizeof(journalMagic) + sizeof(header[0]);
+    if (header[0] != journalVersion)
+    {
+        std::cerr << "Error: Unsupported tile journal version in " << filename << ".\n";
+        return 0;
+    }
+    if (size < sizeof(journalMagic) + sizeof(header))
+    {
+        std::cerr << "Error: " << filename << " is truncated.\n";
+        return 0;
+    }
+    std::memcpy(header, data + sizeof(journalMagic), sizeof(header));
+    const sf::Vector2u& mapSize = tileMap.getMapSize();
+    if (header[1] != mapSize.x || header[2] != mapSize.y)
+    {
+        std::cerr << "Error: " << filename << " was recorded for a " << header[1] << "x" << header[2]
+                  << " map instead of " << mapSize.x << "x" << mapSize.y << ".\n";
+        return 0;
+    }
+    return sizeof(journalMagic) + sizeof(header);
+}
+
+TileJournal::TileJournal(TileMap& tileMap):
+    tileMap(tileMap),
+    historyLimit(defaultHistoryLimit),
+    running(false)
+{
+}
+
+TileJournal::~TileJournal()
+{
+    close();
+}
+
+bool TileJournal::open(const std::string& filename)
+{
+    close();
+
+    // New files start with a header, and existing files are appended to if they were recorded for the same map size
+    bool empty = true;
+    {
+        std::ifstream existing(filename, std::ios::in | std::ios::binary);
+        std::uint8_t header[sizeof(journalMagic) + 3 * sizeof(std::uint32_t)];
+        std::size_t headerSize = static_cast<std::size_t>(existing.read(reinterpret_cast<char*>(header), sizeof(header)).gcount());
+        empty = (headerSize == 0);
+        if (!empty && !checkHeader(header, headerSize, tileMap, filename))
+            return false;
+    }
+    file.open(filename, std::ios::out | std::ios::binary | std::ios::app);
+    if (!file)
+    {
+        std::cerr << "Error: Could not open " << filename << ".\n";
+        return false;
+    }
+    if (empty)
+    {
+        std::uint32_t header[] = {journalVersion, tileMap.getMapSize().x, tileMap.getMapSize().y};
+        file.write(journalMagic, sizeof(journalMagic));
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+    startThread();
+    return true;
+}
+
+void TileJournal::close()
+{
+    stopThread();
+    if (file.is_open())
+        file.close();
+}
+
+void TileJournal::set(int layer, unsigned x, unsigned y, unsigned value)
+{
+    // The tile is read back, since the tile map rejects IDs that are out of range
+    if (tileMap.inBounds(x, y))
+    {
+        unsigned oldValue = tileMap(layer, x, y);
+        tileMap.set(layer, x, y, value);
+        value = tileMap(layer, x, y);
+        if (oldValue != value)
+            record(layer, y * tileMap.getMapSize().x + x, oldValue, value);
+    }
+}
+
+void TileJournal::setRegion(int layer, unsigned x, unsigned y, unsigned width, unsigned height, const unsigned* values)
+{
+    const sf::Vector2u& mapSize = tileMap.getMapSize();
+    unsigned endX = std::min(x + width, mapSize.x);
+    unsigned endY = std::min(y + height, mapSize.y);
+    std::vector<unsigned> oldValues;
+    getRegion(layer, x, y, endX, endY, oldValues);
+    tileMap.setRegion(layer, x, y, width, height, values);
+    recordRegion(layer, x, y, endX, endY, oldValues);
+}
+
+void TileJournal::fill(int layer, unsigned x, unsigned y, unsigned width, unsigned height, unsigned value)
+{
+    const sf::Vector2u& mapSize = tileMap.getMapSize();
+    unsigned endX = std::min(x + width, mapSize.x);
+    unsigned endY = std::min(y + height, mapSize.y);
+    std::vector<unsigned> oldValues;
+    getRegion(layer, x, y, endX, endY, oldValues);
+    tileMap.fill(layer, x, y, width, height, value);
+    recordRegion(layer, x, y, endX, endY, oldValues);
+}
+
+bool TileJournal::commit()
+{
+    if (current.empty())
+        return false;
+    Action action;
+    encode(current, action);
+    current.clear();
+    write(action);
+    undoActions.push_back(std::move(action));
+    if (undoActions.size() > historyLimit)
+        undoActions.pop_front();
+    redoActions.clear();
+    return true;
+}
+
+bool TileJournal::undo()
+{
+    commit();
+    if (undoActions.empty())
+        return false;
+    Action action = std::move(undoActions.back());
+    undoActions.pop_back();
+    std::vector<Run> runs;
+    decode(action.data(), action.size(), runs);
+    apply(tileMap, runs, true);
+
+    // The journal file gets the opposite action, so replaying it still gives the current map
+    std::reverse(runs.begin(), runs.end());
+    for (auto& run: runs)
+        std::swap(run.oldValue, run.value);
+    Action inverse;
+    encode(runs, inverse);
+    write(inverse);
+    redoActions.push_back(std::move(action));
+    return true;
+}
+
+bool TileJournal::redo()
+{
+    commit();
+    if (redoActions.empty())
+        return false;
+    Action action = std::move(redoActions.back());
+    redoActions.pop_back();
+    std::vector<Run> runs;
+    decode(action.data(), action.size(), runs);
+    apply(tileMap, runs, false);
+    write(action);
+    undoActions.push_back(std::move(action));
+    if (undoActions.size() > historyLimit)
+        undoActions.pop_front();
+    return true;
+}
+
+bool TileJournal::canUndo() const
+{
+    return (!undoActions.empty() || !current.empty());
+}
+
+bool TileJournal::canRedo() const
+{
+    return !redoActions.empty();
+}
+
+void TileJournal::setHistoryLimit(unsigned actions)
+{
+    historyLimit = actions;
+    while (undoActions.size() > historyLimit)
+        undoActions.pop_front();
+}
+
+void TileJournal::clearHistory()
+{
+    undoActions.clear();
+    redoActions.clear();
+}
+
+std::size_t TileJournal::getHistoryBytes() const
+{
+    std::size_t bytes = 0;
+    for (auto& action: undoActions)
+        bytes += action.size();
+    for (auto& action: redoActions)
+        bytes += action.size();
+    return bytes;
+}
+
+bool TileJournal::replay(TileMap& tileMap, const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        std::cerr << "Error: Could not open " << filename << ".\n";
+        return false;
+    }
+    std::vector<std::uint8_t> data(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), data.size());
+
+    std::size_t offset = checkHeader(data.data(), data.size(), tileMap, filename);
+    if (!offset)
+        return false;
+
+    // Apply the actions in order, stopping at the first incomplete one (like after a crash)
+    std::vector<Run> runs;
+    while (offset < data.size())
+    {
+        std::uint32_t size = 0;
+        if (!readVarint(data.data(), data.size(), offset, size) || offset + size > data.size() ||
+            !decode(data.data() + offset, size, runs))
+        {
+            std::cerr << "Error: " << filename << " is truncated.\n";
+            return false;
+        }
+        apply(tileMap, runs, false);
+        offset += size;
+    }
+    return true;
+}
+
+void TileJournal::record(int layer, unsigned cell, unsigned oldValue, unsigned value)
+{
+    if (!current.empty())
+    {
+        Run& last = current.back();
+        if (last.layer == layer && last.cell + last.count == cell && last.oldValue == oldValue && last.value == value)
+        {
+            ++last.count;
+            return;
+        }
+    }
+    current.push_back(Run{layer, cell, 1, oldValue, value});
+}
+
+void TileJournal::getRegion(int layer, unsigned x, unsigned y, unsigned endX, unsigned endY, std::vector<unsigned>& values) const
+{
+    values.clear();
+    for (unsigned row = y; row < endY; ++row)
+    {
+        for (unsigned column = x; column < endX; ++column)
+            values.push_back(tileMap(layer, column, row));
+    }
+}
+
+void TileJournal::recordRegion(int layer, unsigned x, unsigned y, unsigned endX, unsigned endY, const std::vector<unsigned>& oldValues)
+{
+    unsigned mapWidth = tileMap.getMapSize().x;
+    auto oldValue = oldValues.begin();
+    for (unsigned row = y; row < endY; ++row)
+    {
+        for (unsigned column = x; column < endX; ++column, ++oldValue)
+        {
+            unsigned value = tileMap(layer, column, row);
+            if (*oldValue != value)
+                record(layer, row * mapWidth + column, *oldValue, value);
+        }
+    }
+}
+
+void TileJournal::encode(const std::vector<Run>& runs, Action& action)
+{
+    action.clear();
+    unsigned previousEnd = 0;
+    for (auto& run: runs)
+    {
+        writeVarint(action, zigzagEncode(run.layer));
+        writeVarint(action, zigzagEncode(static_cast<std::int32_t>(run.cell - previousEnd)));
+        writeVarint(action, run.count);
+        writeVarint(action, run.oldValue);
+        writeVarint(action, run.value);
+        previousEnd = run.cell + run.count;
+    }
+}
+
+bool TileJournal::decode(const std::uint8_t* data, std::size_t size, std::vector<Run>& runs)
+{
+    runs.clear();
+    std::size_t offset = 0;
+    unsigned previousEnd = 0;
+    while (offset < size)
+    {
+        std::uint32_t layer, cellOffset, count, oldValue, value;
+        if (!readVarint(data, size, offset, layer) || !readVarint(data, size, offset, cellOffset) ||
+            !readVarint(data, size, offset, count) || !readVarint(data, size, offset, oldValue) ||
+            !readVarint(data, size, offset, value))
+            return false;
+        unsigned cell = previousEnd + zigzagDecode(cellOffset);
+        runs.push_back(Run{zigzagDecode(layer), cell, count, oldValue, value});
+        previousEnd = cell + count;
+    }
+    return true;
+}
+
+void TileJournal::apply(TileMap& tileMap, const std::vector<Run>& runs, bool undoing)
+{
+    unsigned mapWidth = tileMap.getMapSize().x;
+    if (mapWidth == 0)
+        return;
+    for (std::size_t i = 0; i < runs.size(); ++i)
+    {
+        // Runs can wrap across rows, so they are filled one row at a time
+        const Run& run = runs[undoing ? runs.size() - 1 - i : i];
+        unsigned value = (undoing ? run.oldValue : run.value);
+        unsigned cell = run.cell;
+        for (unsigned remaining = run.count; remaining > 0; )
+        {
+            unsigned x = cell % mapWidth;
+            unsigned count = std::min(remaining, mapWidth - x);
+            tileMap.fill(run.layer, x, cell / mapWidth, count, 1, value);
+            cell += count;
+            remaining -= count;
+        }
+    }
+}
+
+void TileJournal::write(const Action& action)
+{
+    if (thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writes.push_back(action);
+        }
+        condition.notify_one();
+    }
+}
+
+void TileJournal::startThread()
+{
+    running = true;
+    thread = std::thread(&TileJournal::run, this);
+}
+
+void TileJournal::stopThread()
+{
+    if (thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        condition.notify_one();
+        thread.join();
+    }
+}
+
+void TileJournal::run()
+{
+    // Keeps writing until stopped, and then finishes the actions that are left
+    std::unique_lock<std::mutex> lock(mutex);
+    std::deque<Action> batch;
+    std::vector<std::uint8_t> size;
+    while (running || !writes.empty())
+    {
+        if (writes.empty())
+        {
+            condition.wait(lock);
+            continue;
+        }
+        batch.swap(writes);
+
+        // The file is only accessed while unlocked
+        lock.unlock();
+        for (auto& action: batch)
+        {
+            size.clear();
+            writeVarint(size, action.size());
+            file.write(reinterpret_cast<const char*>(size.data()), size.size());
+            file.write(reinterpret_cast<const char*>(action.data()), action.size());
+        }
+        file.flush();
+        batch.clear();
+        lock.lock();
+    }
+}
+
+}
@@ -0,0 +1,296 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/graphics/tilelighting.h"
+#include <algorithm>
+
+namespace ng
+{
+
+const unsigned TileLighting::maxLevel;
+
+TileLighting::TileLighting(TileMap& tileMap):
+    tileMap(tileMap),
+    width(0),
+    height(0)
+{
+    checkSize();
+    for (unsigned level = 0; level <= maxLevel; ++level)
+    {
+        sf::Uint8 value = level * 255 / maxLevel;
+        colors[level] = sf::Color(value, value, value);
+    }
+}
+
+void TileLighting::addLayer(TileMap::LayerHandle layer)
+{
+    layers.push_back(layer);
+    for (unsigned y = 0; y < height; ++y)
+    {
+        for (unsigned x = 0; x < width; ++x)
+            tileMap.setTileColor(layer, x, y, colors[levels(x, y)]);
+    }
+}
+
+void TileLighting::setColors(const sf::Color& dark, const sf::Color& bright)
+{
+    for (unsigned level = 0; level <= maxLevel; ++level)
+    {
+        auto blend = [level](sf::Uint8 from, sf::Uint8 to)
+        {
+            return static_cast<sf::Uint8>(from + (static_cast<int>(to) - from) * static_cast<int>(level) / static_cast<int>(maxLevel));
+        };
+        colors[level] = sf::Color(blend(dark.r, bright.r), blend(dark.g, bright.g), blend(dark.b, bright.b), blend(dark.a, bright.a));
+    }
+    for (unsigned y = 0; y < height; ++y)
+    {
+        for (unsigned x = 0; x < width; ++x)
+            applyColor(x, y);
+    }
+}
+
+void TileLighting::setOpaqueProperties(TileMap::LayerHandle layer, std::uint32_t properties)
+{
+    checkSize();
+    for (unsigned y = 0; y < height; ++y)
+    {
+        for (unsigned x = 0; x < width; ++x)
+            opaqueCells.set(x, y, tileMap.hasProperties(layer, x, y, properties));
+    }
+    relight();
+}
+
+void TileLighting::setOpaque(unsigned x, unsigned y, bool opaque)
+{
+    if (x >= width || y >= height || opaqueCells.get(x, y) == opaque)
+        return;
+    opaqueCells.set(x, y, opaque);
+    unsigned cell = y * width + x;
+    if (opaque)
+    {
+        // Remove the light that passed through the cell, and light it from its neighbors afterwards
+        unsigned oldLevel = levels(x, y);
+        setLevel(cell, sources(x, y));
+        clearedOpaque.push_back(cell);
+        removeLight(cell, oldLevel);
+    }
+    else
+    {
+        // The cell already has the light of its neighbors, so it only needs to pass it on
+        setLevel(cell, std::max<unsigned>(levels(x, y), getNeighborLevel(cell)));
+        spreadQueue.push_back(cell);
+        spreadLight();
+    }
+}
+
+bool TileLighting::isOpaque(unsigned x, unsigned y) const
+{
+    return (x < width && y < height && opaqueCells.get(x, y));
+}
+
+void TileLighting::setSource(unsigned x, unsigned y, unsigned level)
+{
+    level = std::min(level, maxLevel);
+    if (x >= width || y >= height || sources(x, y) == level)
+        return;
+    unsigned oldSource = sources(x, y);
+    sources(x, y) = level;
+    unsigned cell = y * width + x;
+    if (level > levels(x, y))
+    {
+        setLevel(cell, level);
+        spreadQueue.push_back(cell);
+        spreadLight();
+    }
+    else if (level < oldSource)
+    {
+        // The old source may have been lighting the area, so remove its light first
+        unsigned oldLevel = levels(x, y);
+        setLevel(cell, level);
+        if (opaqueCells.get(x, y))
+            clearedOpaque.push_back(cell);
+        removeLight(cell, oldLevel);
+    }
+}
+
+unsigned TileLighting::getSource(unsigned x, unsigned y) const
+{
+    return (x < width && y < height ? sources(x, y) : 0);
+}
+
+unsigned TileLighting::getLevel(unsigned x, unsigned y) const
+{
+    return (x < width && y < height ? levels(x, y) : 0);
+}
+
+void TileLighting::relight()
+{
+    checkSize();
+    for (unsigned y = 0; y < height; ++y)
+    {
+        for (unsigned x = 0; x < width; ++x)
+        {
+            unsigned cell = y * width + x;
+            setLevel(cell, sources(x, y));
+            if (sources(x, y))
+                spreadQueue.push_back(cell);
+        }
+    }
+    spreadLight();
+}
+
+void TileLighting::update()
+{
+    for (unsigned cell: dirtyCells)
+    {
+        unsigned x = cell % width;
+        unsigned y = cell / width;
+        dirty.set(x, y, false);
+        applyColor(x, y);
+    }
+    dirtyCells.clear();
+}
+
+unsigned TileLighting::getDirtyCount() const
+{
+    return dirtyCells.size();
+}
+
+void TileLighting::checkSize()
+{
+    const sf::Vector2u& mapSize = tileMap.getMapSize();
+    if (width != mapSize.x || height != mapSize.y)
+    {
+        width = mapSize.x;
+        height = mapSize.y;
+        levels.resize(width, height, false);
+        sources.resize(width, height, false);
+        opaqueCells.resize(width, height);
+        dirty.resize(width, height);
+        dirtyCells.clear();
+    }
+}
+
+void TileLighting::removeLight(unsigned cell, unsigned oldLevel)
+{
+    removalQueue.push_back(Removal{cell, oldLevel});
+    while (!removalQueue.empty())
+    {
+        Removal removal = removalQueue.front();
+        removalQueue.pop_front();
+        unsigned x = removal.cell % width;
+        unsigned y = removal.cell / width;
+        const unsigned neighbors[4] = {removal.cell - 1, removal.cell + 1, removal.cell - width, removal.cell + width};
+        const bool valid[4] = {x > 0, x + 1 < width, y > 0, y + 1 < height};
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            if (!valid[i])
+                continue;
+            unsigned neighbor = neighbors[i];
+            unsigned neighborX = neighbor % width;
+            unsigned neighborY = neighbor / width;
+            unsigned level = levels(neighborX, neighborY);
+            if (!level)
+                continue;
+            bool opaque = opaqueCells.get(neighborX, neighborY);
+            if (level < removal.level)
+            {
+                // This neighbor could have been lit by the removed light, so clear it down to its own source
+                unsigned emitted = sources(neighborX, neighborY);
+                if (emitted < level)
+                {
+                    setLevel(neighbor, emitted);
+                    if (opaque)
+                        clearedOpaque.push_back(neighbor);
+                    else
+                        removalQueue.push_back(Removal{neighbor, level});
+                }
+                if (emitted)
+                    spreadQueue.push_back(neighbor);
+            }
+            else if (!opaque)
+            {
+                // This neighbor is lit by something else, so its light spreads back into the cleared area
+                spreadQueue.push_back(neighbor);
+            }
+        }
+    }
+    spreadLight();
+    relightOpaque();
+}
+
+void TileLighting::spreadLight()
+{
+    while (!spreadQueue.empty())
+    {
+        unsigned cell = spreadQueue.front();
+        spreadQueue.pop_front();
+        unsigned x = cell % width;
+        unsigned y = cell / width;
+        unsigned level = levels(x, y);
+        if (level <= 1 || opaqueCells.get(x, y))
+            continue;
+        const unsigned neighbors[4] = {cell - 1, cell + 1, cell - width, cell + width};
+        const bool valid[4] = {x > 0, x + 1 < width, y > 0, y + 1 < height};
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            if (valid[i] && levels(neighbors[i] % width, neighbors[i] / width) < level - 1)
+            {
+                setLevel(neighbors[i], level - 1);
+                if (!opaqueCells.get(neighbors[i] % width, neighbors[i] / width))
+                    spreadQueue.push_back(neighbors[i]);
+            }
+        }
+    }
+}
+
+void TileLighting::relightOpaque()
+{
+    for (unsigned cell: clearedOpaque)
+    {
+        unsigned level = std::max<unsigned>(sources(cell % width, cell / width), getNeighborLevel(cell));
+        if (level > levels(cell % width, cell / width))
+            setLevel(cell, level);
+    }
+    clearedOpaque.clear();
+}
+
+unsigned TileLighting::getNeighborLevel(unsigned cell) const
+{
+    unsigned x = cell % width;
+    unsigned y = cell / width;
+    const unsigned neighbors[4] = {cell - 1, cell + 1, cell - width, cell + width};
+    const bool valid[4] = {x > 0, x + 1 < width, y > 0, y + 1 < height};
+    unsigned brightest = 0;
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        unsigned neighborX = neighbors[i] % width;
+        unsigned neighborY = neighbors[i] / width;
+        if (valid[i] && !opaqueCells.get(neighborX, neighborY))
+            brightest = std::max<unsigned>(brightest, levels(neighborX, neighborY));
+    }
+    return (brightest ? brightest - 1 : 0);
+}
+
+void TileLighting::setLevel(unsigned cell, unsigned level)
+{
+    unsigned x = cell % width;
+    unsigned y = cell / width;
+    if (levels(x, y) != level)
+    {
+        levels(x, y) = level;
+        if (!dirty.get(x, y))
+        {
+            dirty.set(x, y, true);
+            dirtyCells.push_back(cell);
+        }
+    }
+}
+
+void TileLighting::applyColor(unsigned x, unsigned y)
+{
+    for (auto layer: layers)
+        tileMap.setTileColor(layer, x, y, colors[levels(x, y)]);
+}
+
+}
@@ -4,13 +4,254 @@
 #include "nage/graphics/tilemap.h"
 #include <configfile.h>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <limits>
+#include "nage/graphics/views.h"
+#include "nage/misc/threadpool.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 namespace ng
 {
 
+const unsigned TileMap::chunkSize;
+const unsigned TileMap::maxLodLevel;
+
+// Marks tile IDs that are not animated
+static const unsigned noAnimation = static_cast<unsigned>(-1);
+
+/*
+Binary map format (all values are 32-bit integers in native byte order):
+    Header: magic ("NGTM"), version, map width, map height, tile width, tile height, tileset count
+    Tileset table: tile width, tile height, total types, padding,
+        filename length, filename (padded to 4 bytes) for each tileset
+    Layer table: layer count, then layer ID, flags for each layer
+        Flags: bit 0 is set for sparse layers, bits 8-15 are the ID size in bytes (0 means 4)
+    Layer data: width * height tile IDs for each layer, in the order of the layer table
+Version 1 files had a single tileset, with its parameters in place of the tileset count and table.
+    An empty tileset filename keeps the tileset that is already loaded, along with its tile size.
+*/
+static const char mapMagic[4] = {'N', 'G', 'T', 'M'};
+static const std::uint32_t mapVersion = 2;
+static const std::uint32_t sparseLayerFlag = 1;
+static const std::uint32_t idSizeShift = 8;
+static const std::uint32_t idSizeMask = 0xFF;
+
+// The sizes of the fixed parts of the table entries, which are used to check counts before allocating anything
+static const std::size_t tilesetEntrySize = 5 * sizeof(std::uint32_t);
+static const std::size_t layerEntrySize = 2 * sizeof(std::uint32_t);
+
+// The largest map that can be loaded, even without any layers, since the map size sets up the chunks and minimap
+static const std::uint64_t maxMapTiles = std::uint64_t(1) << 28;
+
+// The smallest amount of work to split across threads
+static const unsigned minParallelChunks = 4;
+static const unsigned minParallelRows = 64;
+static_assert(sizeof(unsigned) == sizeof(std::uint32_t), "Tile IDs are saved as 32-bit integers");
+static_assert((1u << TileMap::maxLodLevel) == TileMap::chunkSize, "The coarsest level of detail covers a whole chunk");
+
+// Tiles smaller than this many screen pixels are merged by default
+static const float defaultLodThreshold = 2.0f;
+
+// Layers are drawn from their overviews when more chunks than this are visible
+static const unsigned maxLodChunks = 1024;
+
+// The most blocks across or down an overview can have, which caps the vertices of the overview of each layer
+static const unsigned maxOverviewBlocks = 256;
+
+namespace
+{
+
+// A read-only memory mapping of a whole file
+class MappedFile
+{
+    public:
+        MappedFile(const std::string& filename);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        const char* data() const { return fileData; }
+        std::size_t size() const { return fileSize; }
+
+    private:
+        const char* fileData;
+        std::size_t fileSize;
+#ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+#endif
+};
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename):
+    fileData(nullptr),
+    fileSize(0),
+    mapping(nullptr)
+{
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if (file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+            fileData = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (fileData)
+                fileSize = size.QuadPart;
+        }
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (fileData)
+        UnmapViewOfFile(fileData);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename):
+    fileData(nullptr),
+    fileSize(0)
+{
+    int file = open(filename.c_str(), O_RDONLY);
+    if (file >= 0)
+    {
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapped != MAP_FAILED)
+            {
+                fileData = static_cast<const char*>(mapped);
+                fileSize = info.st_size;
+            }
+        }
+        close(file);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (fileData)
+        munmap(const_cast<char*>(fileData), fileSize);
+}
+
+#endif
+
+}
+
+TileMap::TileIds::TileIds():
+    idSize(sizeof(unsigned)),
+    maxValue(static_cast<unsigned>(-1))
+{
+}
+
+void TileMap::TileIds::resize(unsigned count)
+{
+    data.assign(static_cast<std::size_t>(count) * idSize, 0);
+}
+
+void TileMap::TileIds::clear()
+{
+    data.clear();
+}
+
+unsigned TileMap::TileIds::size() const
+{
+    return data.size() / idSize;
+}
+
+unsigned TileMap::TileIds::get(unsigned index) const
+{
+    // Copying the bytes avoids unaligned and aliased reads, and compiles to a single load
+    if (idSize == 1)
+        return data[index];
+    if (idSize == 2)
+    {
+        std::uint16_t value;
+        std::memcpy(&value, &data[index * 2], sizeof(value));
+        return value;
+    }
+    unsigned value;
+    std::memcpy(&value, &data[index * 4], sizeof(value));
+    return value;
+}
+
+void TileMap::TileIds::set(unsigned index, unsigned value)
+{
+    if (idSize == 1)
+        data[index] = value;
+    else if (idSize == 2)
+    {
+        std::uint16_t shortValue = value;
+        std::memcpy(&data[index * 2], &shortValue, sizeof(shortValue));
+    }
+    else
+        std::memcpy(&data[index * 4], &value, sizeof(value));
+}
+
+bool TileMap::TileIds::fits(unsigned value) const
+{
+    return (value <= maxValue);
+}
+
+void TileMap::TileIds::setIdSize(unsigned bytes)
+{
+    // Never narrow below the size needed by the current IDs
+    unsigned count = size();
+    for (unsigned i = 0; i < count && bytes < idSize; ++i)
+        bytes = std::max(bytes, getIdBytes(get(i)));
+    if (bytes == idSize)
+        return;
+    TileIds converted;
+    converted.idSize = bytes;
+    converted.maxValue = (bytes == 1 ? 0xFF : (bytes == 2 ? 0xFFFF : static_cast<unsigned>(-1)));
+    converted.resize(count);
+    for (unsigned i = 0; i < count; ++i)
+        converted.set(i, get(i));
+    *this = std::move(converted);
+}
+
+unsigned TileMap::TileIds::getIdSize() const
+{
+    return idSize;
+}
+
 TileMap::TileMap()
 {
     currentLayer = nullptr;
+    totalTiles = 0;
+    vertexColor = sf::Color::White;
+    drawCalls = 0;
+    usedProperties = 0;
+    lodThreshold = defaultLodThreshold;
+    lodLevel = 0;
+    minimapEnabled = false;
+}
+
+TileMap::TileMap(unsigned fixedWidth, unsigned fixedHeight):
+    TileMap()
+{
+    fixedTileSize.x = tileSize.x = fixedWidth;
+    fixedTileSize.y = tileSize.y = fixedHeight;
 }
 
 bool TileMap::loadFromConfig(const std::string& filename)
@@ -20,30 +261,350 @@ bool TileMap::loadFromConfig(const std::string& filename)
             config("tileHeight").toInt(), config("totalTypes").toInt(), config("padding").toInt()));
 }
 
+bool TileMap::loadFromFile(const std::string& filename)
+{
+    MappedFile file(filename);
+    const char* data = file.data();
+    std::size_t size = file.size();
+
+    // Reads the next integer, or returns false if the file is too short
+    std::size_t offset = 0;
+    auto read = [&](std::uint32_t& value)
+    {
+        if (sizeof(value) > size - offset)
+            return false;
+        std::memcpy(&value, data + offset, sizeof(value));
+        offset += sizeof(value);
+        return true;
+    };
+
+    // Reads a tileset entry from the tileset table
+    struct TilesetInfo
+    {
+        std::uint32_t tileWidth, tileHeight, types, padding;
+        std::string filename;
+    };
+    auto readTileset = [&](TilesetInfo& info)
+    {
+        std::uint32_t nameLength;
+        if (!read(info.tileWidth) || !read(info.tileHeight) || !read(info.types) ||
+            !read(info.padding) || !read(nameLength) || nameLength > size - offset)
+            return false;
+        info.filename.assign(data + offset, nameLength);
+        // The offset never goes past the end, so the remaining size can't underflow
+        offset = std::min<std::size_t>(size, offset + (static_cast<std::size_t>(nameLength) + 3) / 4 * 4);
+        return true;
+    };
+
+    // All of the failures after the magic and version are from missing or inconsistent data
+    auto truncated = [&]
+    {
+        std::cerr << "Error: " << filename << " is truncated.\n";
+        return false;
+    };
+
+    std::uint32_t version, width, height, tileWidth, tileHeight, tilesetCount, layerCount;
+    if (!data)
+    {
+        std::cerr << "Error: Could not open " << filename << ".\n";
+        return false;
+    }
+    if (size < sizeof(mapMagic) || std::memcmp(data, mapMagic, sizeof(mapMagic)) != 0)
+    {
+        std::cerr << "Error: " << filename << " is not a tile map file.\n";
+        return false;
+    }
+    offset = sizeof(mapMagic);
+    if (!read(version) || version < 1 || version > mapVersion)
+    {
+        std::cerr << "Error: Unsupported tile map version in " << filename << ".\n";
+        return false;
+    }
+    std::vector<TilesetInfo> tilesetInfo;
+    bool keepTilesets = false;
+    if (version == 1)
+    {
+        // Version 1 files have a single tileset, which sets the tile size
+        tilesetInfo.resize(1);
+        if (!read(width) || !read(height) || !readTileset(tilesetInfo[0]))
+            return truncated();
+        tileWidth = tilesetInfo[0].tileWidth;
+        tileHeight = tilesetInfo[0].tileHeight;
+        if (tilesetInfo[0].filename.empty())
+        {
+            keepTilesets = true;
+            tilesetInfo.clear();
+            tileWidth = tileSize.x;
+            tileHeight = tileSize.y;
+        }
+    }
+    else
+    {
+        if (!read(width) || !read(height) || !read(tileWidth) || !read(tileHeight) || !read(tilesetCount) ||
+            tilesetCount > (size - offset) / tilesetEntrySize)
+            return truncated();
+        tilesetInfo.resize(tilesetCount);
+        for (auto& info: tilesetInfo)
+        {
+            if (!readTileset(info))
+                return truncated();
+        }
+    }
+    if (static_cast<std::uint64_t>(width) * height > maxMapTiles)
+    {
+        std::cerr << "Error: " << filename << " has a map size of " << width << "x" << height << ", which is too large.\n";
+        return false;
+    }
+
+    // Check the tile sizes before anything is changed, so a map with a fixed tile size is left as it was
+    if (!checkTileSize(tileWidth, tileHeight, filename))
+        return false;
+    for (auto& info: tilesetInfo)
+    {
+        if (!checkTileSize(info.tileWidth, info.tileHeight, filename))
+            return false;
+    }
+
+    // Read the layer table, and make sure all of the layer data is there
+    if (!read(layerCount) || layerCount > (size - offset) / layerEntrySize)
+        return truncated();
+    std::vector<std::uint32_t> layerTableIds(layerCount);
+    std::vector<std::uint32_t> layerFlags(layerCount);
+    for (unsigned i = 0; i < layerCount; ++i)
+    {
+        if (!read(layerTableIds[i]) || !read(layerFlags[i]))
+            return truncated();
+    }
+    std::size_t layerSize = static_cast<std::size_t>(width) * height * sizeof(std::uint32_t);
+    if (layerSize && layerCount > (size - offset) / layerSize)
+        return truncated();
+
+    // Find the largest ID, since the number of types is only known after the tilesets are loaded
+    unsigned maxId = 0;
+    for (unsigned i = 0; i < layerCount; ++i)
+    {
+        const unsigned* ids = reinterpret_cast<const unsigned*>(data + offset + layerSize * i);
+        if (layerSize)
+            maxId = std::max(maxId, *std::max_element(ids, ids + layerSize / sizeof(unsigned)));
+    }
+
+    // Setup the tilesets and an empty map
+    bool status = true;
+    if (!keepTilesets)
+    {
+        tilesets.clear();
+        firstIds.clear();
+        tilesetIds.clear();
+    }
+    for (auto& info: tilesetInfo)
+        status = addTileset(info.filename, info.tileWidth, info.tileHeight, info.types, info.padding) && status;
+    tileSize.x = tileWidth;
+    tileSize.y = tileHeight;
+    layers.clear();
+    layerIds.clear();
+    drawOrder.clear();
+    currentLayer = nullptr;
+    for (auto& anim: animations)
+        anim.tiles.clear();
+    resize(width, height);
+
+    // The layers would be dropped by setRegion(), so the map is left empty instead of partially loaded
+    if (maxId && maxId >= getTotalTypes())
+    {
+        std::cerr << "Error: " << filename << " has a tile ID of " << maxId << ", but there are only "
+                  << getTotalTypes() << " types.\n";
+        return false;
+    }
+
+    // Build the layers straight from the mapped IDs
+    for (unsigned i = 0; i < layerCount; ++i)
+    {
+        const unsigned* ids = reinterpret_cast<const unsigned*>(data + offset + layerSize * i);
+        int layer = static_cast<std::int32_t>(layerTableIds[i]);
+        unsigned idSize = (layerFlags[i] >> idSizeShift) & idSizeMask;
+        createLayer(layer, layerFlags[i] & sparseLayerFlag, (idSize ? idSize : sizeof(unsigned)));
+        setRegion(layer, 0, 0, width, height, ids);
+    }
+    return status;
+}
+
+bool TileMap::saveToFile(const std::string& filename) const
+{
+    // Build the header, tileset table, and layer table
+    std::vector<std::uint32_t> header = {mapVersion, mapSize.x, mapSize.y, tileSize.x, tileSize.y,
+        static_cast<std::uint32_t>(tilesets.size())};
+    std::vector<std::uint32_t> layerTable;
+    layerTable.push_back(drawOrder.size());
+    for (unsigned index: drawOrder)
+    {
+        const TileLayer& layer = layers[index];
+        layerTable.push_back(static_cast<std::uint32_t>(layer.id));
+        std::uint32_t flags = (layer.sparse ? sparseLayerFlag : 0);
+        if (!layer.sparse)
+            flags |= layer.tiles.getIdSize() << idSizeShift;
+        layerTable.push_back(flags);
+    }
+
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(mapMagic, sizeof(mapMagic));
+    file.write(reinterpret_cast<const char*>(header.data()), header.size() * sizeof(std::uint32_t));
+    for (auto& tileset: tilesets)
+    {
+        std::string name = tileset.getFilename();
+        std::uint32_t info[] = {tileset.getTileSize().x, tileset.getTileSize().y, tileset.getTotalTypes(),
+            tileset.getPadding(), static_cast<std::uint32_t>(name.size())};
+        name.resize((name.size() + 3) / 4 * 4, '\0');
+        file.write(reinterpret_cast<const char*>(info), sizeof(info));
+        file.write(name.data(), name.size());
+    }
+    file.write(reinterpret_cast<const char*>(layerTable.data()), layerTable.size() * sizeof(std::uint32_t));
+
+    // Write the IDs of every layer (sparse layers and compact IDs are expanded)
+    std::vector<unsigned> row(mapSize.x);
+    for (unsigned index: drawOrder)
+    {
+        for (unsigned y = 0; y < mapSize.y; ++y)
+        {
+            for (unsigned x = 0; x < mapSize.x; ++x)
+                row[x] = getTile(layers[index], x, y);
+            file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(unsigned));
+        }
+    }
+    return static_cast<bool>(file);
+}
+
 bool TileMap::loadTileset(const std::string& filename, unsigned tileWidth, unsigned tileHeight, unsigned types, unsigned padding)
 {
+    if (!checkTileSize(tileWidth, tileHeight, filename))
+        return false;
     tileSize.x = tileWidth;
     tileSize.y = tileHeight;
-    totalTypes = types;
-    tilePadding = padding;
-    return texture.loadFromFile(filename);
+    tilesets.clear();
+    firstIds.clear();
+    tilesetIds.clear();
+    return addTileset(filename, tileWidth, tileHeight, types, padding);
+}
+
+bool TileMap::addTileset(const std::string& filename, unsigned tileWidth, unsigned tileHeight, unsigned types, unsigned padding)
+{
+    if (!checkTileSize(tileWidth, tileHeight, filename))
+        return false;
+
+    // The new IDs are mapped to the new tileset, even if it fails to load
+    tilesets.emplace_back();
+    bool status = tilesets.back().loadFromFile(filename, tileWidth, tileHeight, types, padding);
+    firstIds.push_back(tilesetIds.size());
+    tilesetIds.resize(tilesetIds.size() + tilesets.back().getTotalTypes(), tilesets.size() - 1);
+
+    // Widen the existing layers so they can still store every type
+    if (!tilesetIds.empty())
+    {
+        unsigned maxValue = tilesetIds.size() - 1;
+        for (auto& layer: layers)
+        {
+            if (!layer.sparse && !layer.tiles.fits(maxValue))
+                layer.tiles.setIdSize(getIdBytes(maxValue));
+        }
+    }
+    return status;
+}
+
+unsigned TileMap::getTilesetCount() const
+{
+    return tilesets.size();
+}
+
+unsigned TileMap::getFirstId(unsigned tileset) const
+{
+    return (tileset < firstIds.size() ? firstIds[tileset] : 0);
 }
 
 void TileMap::resize(unsigned width, unsigned height)
 {
+    // The layers only change (and lose their animated tiles) when the size is different
+    bool changed = (mapSize.x != width || mapSize.y != height);
     mapSize.x = width;
     mapSize.y = height;
     totalTiles = mapSize.x * mapSize.y;
+    chunkCount.x = (mapSize.x + chunkSize - 1) / chunkSize;
+    chunkCount.y = (mapSize.y + chunkSize - 1) / chunkSize;
+
+    // Resizes all current layers, which resets their tiles
+    if (changed)
+    {
+        for (auto& anim: animations)
+            anim.tiles.clear();
+        for (unsigned index = 0; index < layers.size(); ++index)
+        {
+            layers[index].animated.clear();
+            resize(layers[index]);
+            animateDefaultTiles(index);
+        }
+    }
+    updateMinimap(0, 0, mapSize.x, mapSize.y);
+}
 
-    // Resizes all current layers
-    for (auto& layer: tiles)
-        resize(layer.second);
+std::future<void> TileMap::resizeAsync(unsigned width, unsigned height)
+{
+    return ThreadPool::getDefault().run([this, width, height]{ resize(width, height); });
 }
 
 void TileMap::useLayer(int layer)
 {
-    currentLayer = &tiles[layer];
-    resize();
+    // Avoid looking up the layer again when it is already the current one
+    if (!currentLayer || currentLayer->id != layer)
+        useLayer(getLayer(layer));
+}
+
+void TileMap::useLayer(LayerHandle layer)
+{
+    currentLayer = &layers[layer.index];
+    currentLayerIndex = layer.index;
+}
+
+TileMap::LayerHandle TileMap::getLayer(int layer)
+{
+    auto found = layerIds.find(layer);
+    if (found != layerIds.end())
+        return LayerHandle{found->second};
+    return LayerHandle{addLayer(layer, false, sizeof(unsigned))};
+}
+
+TileMap::LayerHandle TileMap::createLayer(int layer, bool sparse, unsigned idSize)
+{
+    idSize = validateIdSize(idSize);
+    auto found = layerIds.find(layer);
+    if (found == layerIds.end())
+    {
+        LayerHandle handle{addLayer(layer, sparse, idSize)};
+        useLayer(handle);
+        return handle;
+    }
+
+    LayerHandle handle{found->second};
+    TileLayer& existing = layers[handle.index];
+    if (existing.sparse != sparse)
+    {
+        // Changing the type of an existing layer resets it
+        removeAnimated(handle.index);
+        existing = TileLayer();
+        existing.id = layer;
+        existing.sparse = sparse;
+        existing.tiles.setIdSize(idSize);
+        resize(existing);
+        animateDefaultTiles(handle.index);
+        updateMinimap(0, 0, mapSize.x, mapSize.y);
+    }
+    else
+        existing.tiles.setIdSize(idSize);
+    useLayer(handle);
+    return handle;
+}
+
+unsigned TileMap::getIdSize(int layer) const
+{
+    auto found = layerIds.find(layer);
+    return (found != layerIds.end() ? layers[found->second].tiles.getIdSize() : 0);
 }
 
 void TileMap::set(int layer, unsigned x, unsigned y, unsigned value)
@@ -52,29 +613,63 @@ void TileMap::set(int layer, unsigned x, unsigned y, unsigned value)
     set(x, y, value);
 }
 
+void TileMap::set(LayerHandle layer, unsigned x, unsigned y, unsigned value)
+{
+    useLayer(layer);
+    set(x, y, value);
+}
+
 void TileMap::set(unsigned x, unsigned y, unsigned value)
 {
-    if (currentLayer && inBounds(x, y))
+    if (currentLayer && inBounds(x, y) && validateId(value))
     {
-        // Store the value
-        currentLayer->tiles[mapSize.x * y + x] = value;
+        if (currentLayer->sparse)
+        {
+            invalidateLod(*currentLayer, x, y, x + 1, y + 1);
+            setSparse(x, y, value);
+            updateMinimap(x, y, x + 1, y + 1);
+            return;
+        }
+        invalidateLod(*currentLayer, x, y, x + 1, y + 1);
+        TileIds& ids = currentLayer->tiles;
+        unsigned index = mapSize.x * y + x;
+        unsigned tile = ids.get(index);
+        unsigned oldDisplay = getFrame(tile);
+        if (!animations.empty())
+            updateAnimated(x, y, tile, value);
+        ids.set(index, value);
+        updateProperties(*currentLayer, x, y, tile, value);
+        displayTile(*currentLayer, x, y, oldDisplay, getFrame(value));
+        updateMinimap(x, y, x + 1, y + 1);
+    }
+}
+
+void TileMap::setRegion(int layer, unsigned x, unsigned y, unsigned width, unsigned height, const unsigned* values)
+{
+    useLayer(layer);
+    unsigned endX = std::min(x + width, mapSize.x);
+    unsigned endY = std::min(y + height, mapSize.y);
+    if (x < endX && y < endY)
+        setRows(x, y, endX, endY, values, width, false);
+}
 
-        // Calculate the tile set position to use
-        int textureWidth = texture.getSize().x;
-        sf::Vector2i tilesetPos(value % (textureWidth / tileSize.x),
-                                value / (textureWidth / tileSize.x));
+void TileMap::setRow(int layer, unsigned x, unsigned y, const unsigned* values, unsigned count)
+{
+    setRegion(layer, x, y, count, 1, values);
+}
 
-        // Setup the texture coordinates
-        sf::Vertex* quad = &currentLayer->vertices[(x + y * mapSize.x) * 4];
-        quad[0].texCoords = sf::Vector2f(tilesetPos.x * (tileSize.x + tilePadding) + tilePadding,
-                                         tilesetPos.y * (tileSize.y + tilePadding) + tilePadding);
-        quad[1].texCoords = sf::Vector2f((tilesetPos.x + 1) * (tileSize.x + tilePadding),
-                                          tilesetPos.y * (tileSize.y + tilePadding) + tilePadding);
-        quad[2].texCoords = sf::Vector2f((tilesetPos.x + 1) * (tileSize.x + tilePadding),
-                                         (tilesetPos.y + 1) * (tileSize.y + tilePadding));
-        quad[3].texCoords = sf::Vector2f(tilesetPos.x * (tileSize.x + tilePadding) + tilePadding,
-                                        (tilesetPos.y + 1) * (tileSize.y + tilePadding));
-    }
+void TileMap::fill(int layer, unsigned value)
+{
+    fill(layer, 0, 0, mapSize.x, mapSize.y, value);
+}
+
+void TileMap::fill(int layer, unsigned x, unsigned y, unsigned width, unsigned height, unsigned value)
+{
+    useLayer(layer);
+    unsigned endX = std::min(x + width, mapSize.x);
+    unsigned endY = std::min(y + height, mapSize.y);
+    if (x < endX && y < endY)
+        setRows(x, y, endX, endY, &value, 0, true);
 }
 
 unsigned TileMap::operator()(int layer, unsigned x, unsigned y) const
@@ -82,18 +677,26 @@ unsigned TileMap::operator()(int layer, unsigned x, unsigned y) const
     unsigned value = 0;
     if (inBounds(x, y))
     {
-        auto found = tiles.find(layer);
-        if (found != tiles.end())
-            value = found->second.tiles[mapSize.x * y + x];
+        auto found = layerIds.find(layer);
+        if (found != layerIds.end())
+            value = getTile(layers[found->second], x, y);
     }
     return value;
 }
 
+unsigned TileMap::operator()(LayerHandle layer, unsigned x, unsigned y) const
+{
+    unsigned value = 0;
+    if (inBounds(x, y))
+        value = getTile(layers[layer.index], x, y);
+    return value;
+}
+
 unsigned TileMap::operator()(unsigned x, unsigned y) const
 {
     unsigned value = 0;
     if (currentLayer && inBounds(x, y))
-        value = currentLayer->tiles[mapSize.x * y + x];
+        value = getTile(*currentLayer, x, y);
     return value;
 }
 
@@ -128,63 +731,1282 @@ void TileMap::setColor(const sf::Color& color)
     applyColor();
 }
 
-unsigned TileMap::getTotalTypes() const
+void TileMap::setTileColor(LayerHandle layer, unsigned x, unsigned y, const sf::Color& color)
 {
-    return totalTypes;
+    if (inBounds(x, y))
+    {
+        sf::Vertex* quad = getQuad(layers[layer.index], x, y);
+        if (quad)
+        {
+            invalidateLod(layers[layer.index], x, y, x + 1, y + 1);
+            for (unsigned i = 0; i < 4; ++i)
+                quad[i].color = color;
+        }
+    }
 }
 
-void TileMap::drawLayer(sf::RenderTarget& target, int layer)
+void TileMap::setMinimapEnabled(bool enabled)
 {
-    sf::RenderStates states;
-    states.transform *= getTransform();
-    states.texture = &texture;
-    target.draw(tiles[layer].vertices, states);
+    minimapEnabled = enabled;
+    if (enabled)
+        updateMinimap(0, 0, mapSize.x, mapSize.y);
+    else
+    {
+        minimapImage = sf::Image();
+        minimapTexture = sf::Texture();
+        minimapDirty.clear();
+    }
 }
 
-void TileMap::draw(sf::RenderTarget& target, sf::RenderStates states) const
+const sf::Texture& TileMap::getMinimap()
 {
-    states.transform *= getTransform();
-    states.texture = &texture;
-    for (auto& layer: tiles)
-        target.draw(layer.second.vertices, states);
+    sf::Vector2u imageSize = minimapImage.getSize();
+    if (imageSize.x == 0 || imageSize.y == 0)
+        return minimapTexture;
+    if (minimapTexture.getSize() != imageSize)
+    {
+        minimapTexture.create(imageSize.x, imageSize.y);
+        minimapDirty.assign(minimapDirty.size(), true);
+    }
+
+    // Upload each run of neighboring dirty chunks in a row as one rectangle
+    const sf::Uint8* pixels = minimapImage.getPixelsPtr();
+    std::vector<sf::Uint8> buffer;
+    for (unsigned cy = 0; cy < chunkCount.y; ++cy)
+    {
+        for (unsigned cx = 0; cx < chunkCount.x; )
+        {
+            if (!minimapDirty[cx + cy * chunkCount.x])
+            {
+                ++cx;
+                continue;
+            }
+            unsigned startCx = cx;
+            for (; cx < chunkCount.x && minimapDirty[cx + cy * chunkCount.x]; ++cx)
+                minimapDirty[cx + cy * chunkCount.x] = false;
+            unsigned x = startCx * chunkSize;
+            unsigned y = cy * chunkSize;
+            unsigned width = std::min(cx * chunkSize, imageSize.x) - x;
+            unsigned height = std::min(y + chunkSize, imageSize.y) - y;
+            if (width == imageSize.x)
+                minimapTexture.update(pixels + static_cast<std::size_t>(y) * imageSize.x * 4, width, height, x, y);
+            else
+            {
+                // The rows of the rectangle aren't contiguous in the image, so they are copied together first
+                buffer.resize(static_cast<std::size_t>(width) * height * 4);
+                for (unsigned row = 0; row < height; ++row)
+                {
+                    const sf::Uint8* source = pixels + (static_cast<std::size_t>(y + row) * imageSize.x + x) * 4;
+                    std::copy(source, source + width * 4, buffer.begin() + static_cast<std::size_t>(row) * width * 4);
+                }
+                minimapTexture.update(buffer.data(), width, height, x, y);
+            }
+        }
+    }
+    return minimapTexture;
 }
 
-void TileMap::resize()
+const sf::Image& TileMap::getMinimapImage() const
 {
-    if (currentLayer)
-        resize(*currentLayer);
+    return minimapImage;
 }
 
-void TileMap::resize(TileLayer& layer)
+const sf::Color& TileMap::getAverageColor(unsigned value) const
 {
-    // Setup arrays if they haven't been setup already
-    if (layer.tiles.size() != totalTiles)
+    if (value < tilesetIds.size())
     {
-        layer.tiles.resize(totalTiles);
-        layer.vertices.setPrimitiveType(sf::Quads);
-        layer.vertices.resize(totalTiles * 4);
+        unsigned tileset = tilesetIds[value];
+        return tilesets[tileset].getAverageColor(value - firstIds[tileset]);
+    }
+    return sf::Color::Transparent;
+}
 
-        // Setup vertices for this layer
-        for (unsigned y = 0; y < mapSize.y; ++y)
-        {
-            for (unsigned x = 0; x < mapSize.x; ++x)
-            {
-                sf::Vertex* quad = &layer.vertices[(x + y * mapSize.x) * 4];
-                quad[0].position = sf::Vector2f(x * tileSize.x, y * tileSize.y);
-                quad[1].position = sf::Vector2f((x + 1) * tileSize.x, y * tileSize.y);
-                quad[2].position = sf::Vector2f((x + 1) * tileSize.x, (y + 1) * tileSize.y);
-                quad[3].position = sf::Vector2f(x * tileSize.x, (y + 1) * tileSize.y);
-            }
-        }
+unsigned TileMap::getTotalTypes() const
+{
+    return tilesetIds.size();
+}
+
+void TileMap::setProperties(unsigned value, std::uint32_t properties)
+{
+    if (value >= typeProperties.size())
+        typeProperties.resize(value + 1, 0);
+    typeProperties[value] = properties;
+    usedProperties |= properties;
+    for (auto& layer: layers)
+    {
+        resetProperties(layer);
+        buildProperties(layer, 0, 0, mapSize.x, mapSize.y);
     }
 }
 
-void TileMap::applyColor()
+std::uint32_t TileMap::getProperties(unsigned value) const
+{
+    return (value < typeProperties.size() ? typeProperties[value] : 0);
+}
+
+bool TileMap::hasProperties(LayerHandle layer, unsigned x, unsigned y, std::uint32_t properties) const
 {
-    for (auto& layer: tiles)
+    if (!inBounds(x, y))
+        return false;
+    const TileLayer& tileLayer = layers[layer.index];
+    properties &= usedProperties;
+    for (unsigned bit = 0; properties; ++bit, properties >>= 1)
     {
-        for (unsigned i = 0; i < layer.second.vertices.getVertexCount(); ++i)
-            layer.second.vertices[i].color = vertexColor;
+        if ((properties & 1) && tileLayer.propertyRows[bit].get(x, y))
+            return true;
+    }
+    return false;
+}
+
+bool TileMap::overlaps(LayerHandle layer, const sf::FloatRect& rect, std::uint32_t properties) const
+{
+    if (tileSize.x == 0 || tileSize.y == 0)
+        return false;
+
+    // Find the range of tiles the rectangle overlaps, clipped to the map
+    int startX = std::max(0, static_cast<int>(std::floor(rect.left / tileSize.x)));
+    int startY = std::max(0, static_cast<int>(std::floor(rect.top / tileSize.y)));
+    int endX = std::min(static_cast<int>(mapSize.x), static_cast<int>(std::ceil((rect.left + rect.width) / tileSize.x)));
+    int endY = std::min(static_cast<int>(mapSize.y), static_cast<int>(std::ceil((rect.top + rect.height) / tileSize.y)));
+    if (startX >= endX || startY >= endY)
+        return false;
+
+    const TileLayer& tileLayer = layers[layer.index];
+    properties &= usedProperties;
+    for (unsigned bit = 0; properties; ++bit, properties >>= 1)
+    {
+        if ((properties & 1) && tileLayer.propertyRows[bit].any(startX, startY, endX, endY))
+            return true;
+    }
+    return false;
+}
+
+bool TileMap::raycast(LayerHandle layer, const sf::Vector2f& start, const sf::Vector2f& end, std::uint32_t properties, sf::Vector2u* hit) const
+{
+    if (tileSize.x == 0 || tileSize.y == 0)
+        return false;
+
+    // Step through every tile the line crosses, always crossing the nearest tile edge next
+    sf::Vector2f direction = end - start;
+    int x = static_cast<int>(std::floor(start.x / tileSize.x));
+    int y = static_cast<int>(std::floor(start.y / tileSize.y));
+    int endX = static_cast<int>(std::floor(end.x / tileSize.x));
+    int endY = static_cast<int>(std::floor(end.y / tileSize.y));
+    int stepX = (direction.x > 0 ? 1 : (direction.x < 0 ? -1 : 0));
+    int stepY = (direction.y > 0 ? 1 : (direction.y < 0 ? -1 : 0));
+
+    // The fraction of the line to reach the next vertical and horizontal tile edges, and to cross a whole tile
+    const float never = std::numeric_limits<float>::infinity();
+    float nextX = (stepX ? ((x + (stepX > 0)) * static_cast<float>(tileSize.x) - start.x) / direction.x : never);
+    float nextY = (stepY ? ((y + (stepY > 0)) * static_cast<float>(tileSize.y) - start.y) / direction.y : never);
+    float deltaX = (stepX ? tileSize.x / std::abs(direction.x) : never);
+    float deltaY = (stepY ? tileSize.y / std::abs(direction.y) : never);
+
+    unsigned steps = std::abs(endX - x) + std::abs(endY - y);
+    for (unsigned i = 0; ; ++i)
+    {
+        if (hasProperties(layer, x, y, properties))
+        {
+            if (hit)
+                *hit = sf::Vector2u(x, y);
+            return true;
+        }
+        if (i == steps)
+            return false;
+        if (nextX < nextY)
+        {
+            x += stepX;
+            nextX += deltaX;
+        }
+        else
+        {
+            y += stepY;
+            nextY += deltaY;
+        }
+    }
+}
+
+unsigned TileMap::findInColumn(LayerHandle layer, unsigned x, unsigned startY, std::uint32_t properties) const
+{
+    if (x >= mapSize.x)
+        return mapSize.y;
+    const TileLayer& tileLayer = layers[layer.index];
+    unsigned found = mapSize.y;
+    properties &= usedProperties;
+    for (unsigned bit = 0; properties; ++bit, properties >>= 1)
+    {
+        if (properties & 1)
+            found = tileLayer.propertyColumns[bit].findInRow(x, startY, found);
+    }
+    return found;
+}
+
+void TileMap::addAnimation(unsigned value, const std::vector<unsigned>& frames, float frameDuration)
+{
+    unsigned oldDisplay = getFrame(value);
+    TileAnimation* anim = findAnimation(value);
+    if (!anim)
+    {
+        if (value >= animationIds.size())
+            animationIds.resize(value + 1, noAnimation);
+        animationIds[value] = animations.size();
+        animations.emplace_back();
+        anim = &animations.back();
+
+        // Index the tiles that already have this ID
+        for (unsigned layerIndex = 0; layerIndex < layers.size(); ++layerIndex)
+        {
+            TileLayer& layer = layers[layerIndex];
+            std::vector<unsigned> found;
+            for (unsigned i = 0; i < layer.tiles.size(); ++i)
+            {
+                if (layer.tiles.get(i) == value)
+                    found.push_back(i);
+            }
+            for (auto& chunk: layer.chunks)
+            {
+                for (auto& batch: chunk.batches)
+                {
+                    for (unsigned i = 0; i < batch.cells.size(); ++i)
+                    {
+                        if (batch.values[i] == value)
+                            found.push_back(batch.cells[i]);
+                    }
+                }
+            }
+            for (unsigned index: found)
+            {
+                layer.animated[index] = anim->tiles.size();
+                anim->tiles.push_back(AnimatedTile{layerIndex, index % mapSize.x, index / mapSize.x});
+            }
+        }
+    }
+    anim->frames = frames;
+    anim->frameDuration = frameDuration;
+    anim->elapsed = 0;
+    anim->currentFrame = 0;
+    applyAnimation(*anim, oldDisplay);
+}
+
+void TileMap::update(float dt)
+{
+    for (auto& anim: animations)
+    {
+        if (anim.frames.empty() || anim.frameDuration <= 0)
+            continue;
+        anim.elapsed += dt;
+        if (anim.elapsed < anim.frameDuration)
+            continue;
+
+        // Skip ahead as many frames as have passed
+        unsigned steps = anim.elapsed / anim.frameDuration;
+        anim.elapsed -= steps * anim.frameDuration;
+        unsigned frame = (anim.currentFrame + steps) % anim.frames.size();
+        if (frame != anim.currentFrame)
+        {
+            unsigned oldDisplay = anim.frames[anim.currentFrame];
+            anim.currentFrame = frame;
+            applyAnimation(anim, oldDisplay);
+        }
+    }
+}
+
+void TileMap::drawLayer(sf::RenderTarget& target, int layer)
+{
+    auto found = layerIds.find(layer);
+    if (found != layerIds.end())
+        drawLayer(target, LayerHandle{found->second});
+    else
+        drawCalls = 0;
+}
+
+void TileMap::drawLayer(sf::RenderTarget& target, LayerHandle layer)
+{
+    drawCalls = 0;
+    sf::RenderStates states;
+    states.transform *= getTransform();
+    drawChunks(layers[layer.index], target, states);
+}
+
+void TileMap::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    drawCalls = 0;
+    states.transform *= getTransform();
+    for (unsigned index: drawOrder)
+        drawChunks(layers[index], target, states);
+}
+
+unsigned TileMap::getDrawCalls() const
+{
+    return drawCalls;
+}
+
+void TileMap::setLodThreshold(float pixels)
+{
+    lodThreshold = pixels;
+}
+
+unsigned TileMap::getLodLevel() const
+{
+    return lodLevel;
+}
+
+unsigned TileMap::addLayer(int layer, bool sparse, unsigned idSize)
+{
+    unsigned index = layers.size();
+    layers.emplace_back();
+    TileLayer& newLayer = layers.back();
+    newLayer.id = layer;
+    newLayer.sparse = sparse;
+    newLayer.tiles.setIdSize(idSize);
+    resize(newLayer);
+    layerIds[layer] = index;
+    animateDefaultTiles(index);
+
+    // Keep the draw order sorted by layer ID
+    auto position = std::upper_bound(drawOrder.begin(), drawOrder.end(), layer,
+        [this](int id, unsigned other){ return id < layers[other].id; });
+    drawOrder.insert(position, index);
+    if (!sparse)
+        updateMinimap(0, 0, mapSize.x, mapSize.y);
+    return index;
+}
+
+unsigned TileMap::validateIdSize(unsigned idSize) const
+{
+    // Make sure the IDs of all of the types can be stored
+    unsigned minIdSize = (getTotalTypes() ? getIdBytes(getTotalTypes() - 1) : 1);
+    if (idSize != 1 && idSize != 2 && idSize != 4)
+    {
+        std::cerr << "Error: Invalid tile ID size of " << idSize << " bytes, using 4 bytes.\n";
+        idSize = 4;
+    }
+    else if (idSize < minIdSize)
+    {
+        std::cerr << "Error: Tile ID size of " << idSize << " bytes is too small for " << getTotalTypes()
+                  << " types, using " << minIdSize << " bytes.\n";
+        idSize = minIdSize;
+    }
+    return idSize;
+}
+
+void TileMap::resize(TileLayer& layer)
+{
+    // Setup arrays if they haven't been setup already
+    if (layer.size != mapSize)
+    {
+        layer.size = mapSize;
+        layer.chunks.clear();
+        layer.chunks.resize(chunkCount.x * chunkCount.y);
+        layer.overview.clear();
+        layer.overviewLevel = 0;
+        resetProperties(layer);
+
+        // Sparse layers start out empty, and quads are added as tiles are set
+        if (layer.sparse)
+        {
+            layer.tiles.clear();
+            return;
+        }
+        layer.tiles.resize(totalTiles);
+
+        // Setup vertices for each chunk of this layer, using the first tileset
+        // The chunks are independent, so they are built in parallel
+        ThreadPool::getDefault().parallelFor(layer.chunks.size(), [&](unsigned begin, unsigned end)
+        {
+            for (unsigned index = begin; index < end; ++index)
+            {
+                unsigned startX = (index % chunkCount.x) * chunkSize;
+                unsigned startY = (index / chunkCount.x) * chunkSize;
+                unsigned endX = std::min(startX + chunkSize, mapSize.x);
+                unsigned endY = std::min(startY + chunkSize, mapSize.y);
+                TileChunk& chunk = layer.chunks[index];
+                chunk.batches.resize(1);
+                chunk.batches[0].tileset = 0;
+                sf::VertexArray& vertices = chunk.batches[0].vertices;
+                vertices.setPrimitiveType(sf::Quads);
+                vertices.resize((endX - startX) * (endY - startY) * 4);
+                sf::Vertex* quad = &vertices[0];
+                for (unsigned y = startY; y < endY; ++y)
+                {
+                    for (unsigned x = startX; x < endX; ++x, quad += 4)
+                    {
+                        setPositions(quad, x, y);
+                        for (unsigned i = 0; i < 4; ++i)
+                            quad[i].color = vertexColor;
+                    }
+                }
+            }
+        }, minParallelChunks);
+    }
+}
+
+void TileMap::applyColor()
+{
+    for (auto& layer: layers)
+    {
+        auto& chunks = layer.chunks;
+        layer.overviewLevel = 0;
+        ThreadPool::getDefault().parallelFor(chunks.size(), [&](unsigned begin, unsigned end)
+        {
+            for (unsigned index = begin; index < end; ++index)
+            {
+                chunks[index].lodBuilt = 0;
+                for (auto& batch: chunks[index].batches)
+                {
+                    for (unsigned i = 0; i < batch.vertices.getVertexCount(); ++i)
+                        batch.vertices[i].color = vertexColor;
+                }
+            }
+        }, minParallelChunks);
+    }
+}
+
+void TileMap::resetProperties(TileLayer& layer)
+{
+    unsigned propertyCount = 0;
+    while (propertyCount < 32 && (usedProperties >> propertyCount))
+        ++propertyCount;
+    layer.propertyRows.assign(propertyCount, BitMatrix());
+    layer.propertyColumns.assign(propertyCount, BitMatrix());
+    std::uint32_t emptyProperties = getProperties(0);
+    for (unsigned bit = 0; bit < propertyCount; ++bit)
+    {
+        if ((usedProperties >> bit) & 1)
+        {
+            bool value = (emptyProperties >> bit) & 1;
+            layer.propertyRows[bit].resize(mapSize.x, mapSize.y);
+            layer.propertyRows[bit].fill(value);
+            layer.propertyColumns[bit].resize(mapSize.y, mapSize.x);
+            layer.propertyColumns[bit].fill(value);
+        }
+    }
+}
+
+void TileMap::buildProperties(TileLayer& layer, unsigned x, unsigned y, unsigned endX, unsigned endY)
+{
+    if (!usedProperties)
+        return;
+    for (unsigned tileY = y; tileY < endY; ++tileY)
+    {
+        for (unsigned tileX = x; tileX < endX; ++tileX)
+        {
+            std::uint32_t properties = getProperties(getTile(layer, tileX, tileY));
+            for (unsigned bit = 0; bit < layer.propertyRows.size(); ++bit)
+            {
+                if ((usedProperties >> bit) & 1)
+                {
+                    bool value = (properties >> bit) & 1;
+                    layer.propertyRows[bit].set(tileX, tileY, value);
+                    layer.propertyColumns[bit].set(tileY, tileX, value);
+                }
+            }
+        }
+    }
+}
+
+void TileMap::updateProperties(TileLayer& layer, unsigned x, unsigned y, unsigned oldValue, unsigned value)
+{
+    std::uint32_t properties = getProperties(value);
+    std::uint32_t changed = getProperties(oldValue) ^ properties;
+    for (unsigned bit = 0; changed; ++bit, changed >>= 1, properties >>= 1)
+    {
+        if (changed & 1)
+        {
+            layer.propertyRows[bit].set(x, y, properties & 1);
+            layer.propertyColumns[bit].set(y, x, properties & 1);
+        }
+    }
+}
+
+unsigned TileMap::getTile(const TileLayer& layer, unsigned x, unsigned y) const
+{
+    unsigned index = mapSize.x * y + x;
+    if (!layer.sparse)
+        return layer.tiles.get(index);
+    const TileChunk& chunk = layer.chunks[(x / chunkSize) + (y / chunkSize) * chunkCount.x];
+    auto found = chunk.slots.find(index);
+    return (found != chunk.slots.end() ? chunk.batches[found->second.batch].values[found->second.quad] : 0);
+}
+
+void TileMap::setSparse(unsigned x, unsigned y, unsigned value)
+{
+    TileChunk& chunk = getChunk(*currentLayer, x, y);
+    unsigned index = mapSize.x * y + x;
+    auto found = chunk.slots.find(index);
+    unsigned oldValue = 0;
+    if (found != chunk.slots.end())
+        oldValue = chunk.batches[found->second.batch].values[found->second.quad];
+    if (oldValue == value)
+        return;
+    if (!animations.empty())
+        updateAnimated(x, y, oldValue, value);
+    updateProperties(*currentLayer, x, y, oldValue, value);
+
+    if (!oldValue)
+        addSparseQuad(chunk, x, y, value, getFrame(value), vertexColor);
+    else if (!value)
+        removeSparseQuad(chunk, index);
+    else
+    {
+        // Update the existing quad
+        TileSlot slot = found->second;
+        chunk.batches[slot.batch].values[slot.quad] = value;
+        displayTile(*currentLayer, x, y, getFrame(oldValue), getFrame(value));
+    }
+}
+
+bool TileMap::checkTileSize(unsigned tileWidth, unsigned tileHeight, const std::string& filename) const
+{
+    if (fixedTileSize.x && (tileWidth != fixedTileSize.x || tileHeight != fixedTileSize.y))
+    {
+        std::cerr << "Error: " << filename << " has a tile size of " << tileWidth << "x" << tileHeight
+                  << " instead of " << fixedTileSize.x << "x" << fixedTileSize.y << ".\n";
+        return false;
+    }
+    return true;
+}
+
+bool TileMap::validateId(unsigned value) const
+{
+    // ID 0 clears tiles, so it is valid even before any tilesets are loaded
+    if (value == 0 || value < getTotalTypes())
+        return true;
+    std::cerr << "Error: Tile ID " << value << " is out of range, there are only " << getTotalTypes() << " types.\n";
+    return false;
+}
+
+unsigned TileMap::getIdBytes(unsigned value)
+{
+    if (value <= 0xFF)
+        return 1;
+    if (value <= 0xFFFF)
+        return 2;
+    return 4;
+}
+
+void TileMap::setPositions(sf::Vertex* quad, unsigned x, unsigned y) const
+{
+    quad[0].position = sf::Vector2f(x * tileSize.x, y * tileSize.y);
+    quad[1].position = sf::Vector2f((x + 1) * tileSize.x, y * tileSize.y);
+    quad[2].position = sf::Vector2f((x + 1) * tileSize.x, (y + 1) * tileSize.y);
+    quad[3].position = sf::Vector2f(x * tileSize.x, (y + 1) * tileSize.y);
+}
+
+void TileMap::hideQuad(sf::Vertex* quad) const
+{
+    quad[1].position = quad[0].position;
+    quad[2].position = quad[0].position;
+    quad[3].position = quad[0].position;
+}
+
+unsigned TileMap::getTileset(unsigned value) const
+{
+    return (value < tilesetIds.size() ? tilesetIds[value] : 0);
+}
+
+void TileMap::setTexCoords(sf::Vertex* quad, unsigned value) const
+{
+    // Unknown types are left with the texture coordinates they had before
+    if (value < tilesetIds.size())
+    {
+        unsigned tileset = tilesetIds[value];
+        tilesets[tileset].setTexCoords(quad, value - firstIds[tileset]);
+    }
+}
+
+void TileMap::displayTile(TileLayer& layer, unsigned x, unsigned y, unsigned oldDisplay, unsigned display)
+{
+    unsigned oldTileset = getTileset(oldDisplay);
+    unsigned tileset = getTileset(display);
+    if (layer.sparse)
+    {
+        TileChunk& chunk = getChunk(layer, x, y);
+        unsigned index = mapSize.x * y + x;
+        TileSlot slot = chunk.slots.find(index)->second;
+        if (chunk.batches[slot.batch].tileset != tileset)
+        {
+            // Move the quad to the batch of the new tileset, keeping its value and color
+            unsigned value = chunk.batches[slot.batch].values[slot.quad];
+            sf::Color color = chunk.batches[slot.batch].vertices[slot.quad * 4].color;
+            removeSparseQuad(chunk, index);
+            addSparseQuad(chunk, x, y, value, display, color);
+        }
+        else
+            setTexCoords(&chunk.batches[slot.batch].vertices[slot.quad * 4], display);
+        return;
+    }
+
+    unsigned quadIndex = getChunkIndex(x, y) * 4;
+    sf::Vertex* quad = &getBatch(layer, x, y, tileset).vertices[quadIndex];
+    if (oldTileset != tileset)
+    {
+        // Hide the tile in the batch of the old tileset, and show it in the new one
+        sf::Vertex* oldQuad = &getBatch(layer, x, y, oldTileset).vertices[quadIndex];
+        for (unsigned i = 0; i < 4; ++i)
+            quad[i].color = oldQuad[i].color;
+        hideQuad(oldQuad);
+        setPositions(quad, x, y);
+    }
+    setTexCoords(quad, display);
+}
+
+void TileMap::setRows(unsigned x, unsigned y, unsigned endX, unsigned endY, const unsigned* values, unsigned pitch, bool repeat)
+{
+    // Rows only touch their own tiles and quads when the layer is normal, there is a single tileset,
+    // and there are no animations, so then they are set in parallel
+    // The property bits of normal layers are set afterwards, since neighboring tiles share words
+    // The whole region is rejected if any of the IDs are out of range
+    unsigned maxValue = *values;
+    for (unsigned row = y; row < endY && !repeat; ++row)
+    {
+        const unsigned* rowValues = values + (row - y) * pitch;
+        maxValue = std::max(maxValue, *std::max_element(rowValues, rowValues + (endX - x)));
+    }
+    if (!validateId(maxValue))
+        return;
+
+    TileLayer& layer = *currentLayer;
+    invalidateLod(layer, x, y, endX, endY);
+    if (layer.sparse || tilesets.size() > 1 || !animations.empty() || endY - y < minParallelRows)
+    {
+        for (unsigned row = y; row < endY; ++row)
+            setRun(x, row, endX - x, values + (row - y) * pitch, repeat);
+        if (!layer.sparse)
+            buildProperties(layer, x, y, endX, endY);
+        updateMinimap(x, y, endX, endY);
+        return;
+    }
+
+    ThreadPool::getDefault().parallelFor(endY - y, [&](unsigned begin, unsigned end)
+    {
+        for (unsigned row = begin; row < end; ++row)
+            setRun(x, y + row, endX - x, values + row * pitch, repeat);
+    }, minParallelRows);
+    buildProperties(layer, x, y, endX, endY);
+    updateMinimap(x, y, endX, endY);
+}
+
+void TileMap::setRun(unsigned x, unsigned y, unsigned count, const unsigned* values, bool repeat)
+{
+    TileLayer& layer = *currentLayer;
+    unsigned step = (repeat ? 0 : 1);
+    if (layer.sparse)
+    {
+        for (unsigned endX = x + count; x < endX; ++x, values += step)
+            setSparse(x, y, *values);
+        return;
+    }
+    TileIds& ids = layer.tiles;
+    unsigned index = mapSize.x * y + x;
+    unsigned endX = x + count;
+
+    // Tiles can move between batches when there are multiple tilesets
+    if (tilesets.size() > 1)
+    {
+        for (; x < endX; ++x, ++index, values += step)
+        {
+            unsigned oldValue = ids.get(index);
+            if (!animations.empty())
+                updateAnimated(x, y, oldValue, *values);
+            ids.set(index, *values);
+            displayTile(layer, x, y, getFrame(oldValue), getFrame(*values));
+        }
+        return;
+    }
+
+    // The quads of a row are contiguous within each chunk
+    while (x < endX)
+    {
+        unsigned chunkEndX = std::min((x / chunkSize + 1) * chunkSize, endX);
+        sf::Vertex* quad = getQuad(layer, x, y);
+        for (; x < chunkEndX; ++x, quad += 4, ++index, values += step)
+        {
+            if (!animations.empty())
+                updateAnimated(x, y, ids.get(index), *values);
+            ids.set(index, *values);
+            setTexCoords(quad, getFrame(*values));
+        }
+    }
+}
+
+unsigned TileMap::getFrame(unsigned value) const
+{
+    if (value < animationIds.size() && animationIds[value] != noAnimation)
+    {
+        const TileAnimation& anim = animations[animationIds[value]];
+        if (!anim.frames.empty())
+            return anim.frames[anim.currentFrame];
+    }
+    return value;
+}
+
+void TileMap::applyAnimation(const TileAnimation& anim, unsigned oldDisplay)
+{
+    if (anim.frames.empty())
+        return;
+
+    // Only the quads of the tiles using this animation are touched
+    unsigned value = anim.frames[anim.currentFrame];
+    for (auto& tile: anim.tiles)
+    {
+        invalidateLod(layers[tile.layer], tile.x, tile.y, tile.x + 1, tile.y + 1);
+        displayTile(layers[tile.layer], tile.x, tile.y, oldDisplay, value);
+    }
+}
+
+TileMap::TileAnimation* TileMap::findAnimation(unsigned value)
+{
+    if (value < animationIds.size() && animationIds[value] != noAnimation)
+        return &animations[animationIds[value]];
+    return nullptr;
+}
+
+void TileMap::updateAnimated(unsigned x, unsigned y, unsigned oldValue, unsigned value)
+{
+    if (oldValue == value)
+        return;
+    TileLayer& layer = *currentLayer;
+    unsigned index = mapSize.x * y + x;
+
+    // Remove the tile from its old animation by swapping in the last tile
+    TileAnimation* anim = findAnimation(oldValue);
+    if (anim)
+    {
+        auto found = layer.animated.find(index);
+        if (found != layer.animated.end())
+        {
+            unsigned pos = found->second;
+            layer.animated.erase(found);
+            anim->tiles[pos] = anim->tiles.back();
+            anim->tiles.pop_back();
+            if (pos < anim->tiles.size())
+            {
+                const AnimatedTile& moved = anim->tiles[pos];
+                layers[moved.layer].animated[mapSize.x * moved.y + moved.x] = pos;
+            }
+        }
+    }
+
+    // Add the tile to its new animation
+    anim = findAnimation(value);
+    if (anim)
+    {
+        layer.animated[index] = anim->tiles.size();
+        anim->tiles.push_back(AnimatedTile{currentLayerIndex, x, y});
+    }
+}
+
+void TileMap::removeAnimated(unsigned layer)
+{
+    for (auto& anim: animations)
+    {
+        auto removed = std::remove_if(anim.tiles.begin(), anim.tiles.end(),
+            [layer](const AnimatedTile& tile){ return tile.layer == layer; });
+        if (removed != anim.tiles.end())
+        {
+            // The remaining tiles have moved, so their positions need to be updated
+            anim.tiles.erase(removed, anim.tiles.end());
+            for (unsigned i = 0; i < anim.tiles.size(); ++i)
+                layers[anim.tiles[i].layer].animated[mapSize.x * anim.tiles[i].y + anim.tiles[i].x] = i;
+        }
+    }
+    layers[layer].animated.clear();
+}
+
+void TileMap::animateDefaultTiles(unsigned layer)
+{
+    TileAnimation* anim = findAnimation(0);
+    TileLayer& tileLayer = layers[layer];
+    if (!anim || tileLayer.sparse)
+        return;
+    anim->tiles.reserve(anim->tiles.size() + totalTiles);
+    for (unsigned y = 0; y < mapSize.y; ++y)
+    {
+        for (unsigned x = 0; x < mapSize.x; ++x)
+        {
+            tileLayer.animated[mapSize.x * y + x] = anim->tiles.size();
+            anim->tiles.push_back(AnimatedTile{layer, x, y});
+            if (!anim->frames.empty())
+                displayTile(tileLayer, x, y, 0, anim->frames[anim->currentFrame]);
+        }
+    }
+}
+
+TileMap::TileChunk& TileMap::getChunk(TileLayer& layer, unsigned x, unsigned y)
+{
+    return layer.chunks[(x / chunkSize) + (y / chunkSize) * chunkCount.x];
+}
+
+unsigned TileMap::getChunkTiles(unsigned chunkX, unsigned chunkY) const
+{
+    return std::min(chunkSize, mapSize.x - chunkX * chunkSize) * std::min(chunkSize, mapSize.y - chunkY * chunkSize);
+}
+
+unsigned TileMap::getChunkIndex(unsigned x, unsigned y) const
+{
+    // Edge chunks can be narrower than the chunk size
+    unsigned cx = x / chunkSize;
+    unsigned cy = y / chunkSize;
+    unsigned chunkWidth = std::min(chunkSize, mapSize.x - cx * chunkSize);
+    return (x - cx * chunkSize) + (y - cy * chunkSize) * chunkWidth;
+}
+
+TileMap::TileBatch& TileMap::getBatch(TileLayer& layer, unsigned x, unsigned y, unsigned tileset)
+{
+    TileChunk& chunk = getChunk(layer, x, y);
+    unsigned batchIndex = findBatch(chunk, tileset);
+    if (batchIndex == chunk.batches.size())
+    {
+        chunk.batches.emplace_back();
+        TileBatch& batch = chunk.batches.back();
+        batch.tileset = tileset;
+        batch.vertices.setPrimitiveType(sf::Quads);
+        if (!layer.sparse)
+        {
+            // Normal layers have a quad for every tile, which start out hidden
+            unsigned startX = x / chunkSize * chunkSize;
+            unsigned startY = y / chunkSize * chunkSize;
+            unsigned endX = std::min(startX + chunkSize, mapSize.x);
+            unsigned endY = std::min(startY + chunkSize, mapSize.y);
+            batch.vertices.resize(getChunkTiles(x / chunkSize, y / chunkSize) * 4);
+            sf::Vertex* quad = &batch.vertices[0];
+            for (unsigned tileY = startY; tileY < endY; ++tileY)
+            {
+                for (unsigned tileX = startX; tileX < endX; ++tileX, quad += 4)
+                {
+                    setPositions(quad, tileX, tileY);
+                    hideQuad(quad);
+                    for (unsigned i = 0; i < 4; ++i)
+                        quad[i].color = vertexColor;
+                }
+            }
+        }
+    }
+    return chunk.batches[batchIndex];
+}
+
+unsigned TileMap::findBatch(const TileChunk& chunk, unsigned tileset) const
+{
+    unsigned batchIndex = 0;
+    while (batchIndex < chunk.batches.size() && chunk.batches[batchIndex].tileset != tileset)
+        ++batchIndex;
+    return batchIndex;
+}
+
+void TileMap::addSparseQuad(TileChunk& chunk, unsigned x, unsigned y, unsigned value, unsigned display, const sf::Color& color)
+{
+    // Add a new quad to the end of the batch of its tileset
+    unsigned tileset = getTileset(display);
+    unsigned batchIndex = findBatch(chunk, tileset);
+    if (batchIndex == chunk.batches.size())
+    {
+        chunk.batches.emplace_back();
+        chunk.batches.back().tileset = tileset;
+        chunk.batches.back().vertices.setPrimitiveType(sf::Quads);
+    }
+    TileBatch& batch = chunk.batches[batchIndex];
+    unsigned quadIndex = batch.cells.size();
+    unsigned index = mapSize.x * y + x;
+    chunk.slots[index] = TileSlot{batchIndex, quadIndex};
+    batch.cells.push_back(index);
+    batch.values.push_back(value);
+    batch.vertices.resize((quadIndex + 1) * 4);
+    sf::Vertex* quad = &batch.vertices[quadIndex * 4];
+    setPositions(quad, x, y);
+    for (unsigned i = 0; i < 4; ++i)
+        quad[i].color = color;
+    setTexCoords(quad, display);
+}
+
+void TileMap::removeSparseQuad(TileChunk& chunk, unsigned index)
+{
+    // Remove the quad by moving the last quad of its batch into its place
+    auto found = chunk.slots.find(index);
+    TileSlot slot = found->second;
+    chunk.slots.erase(found);
+    TileBatch& batch = chunk.batches[slot.batch];
+    unsigned last = batch.cells.size() - 1;
+    if (slot.quad != last)
+    {
+        for (unsigned i = 0; i < 4; ++i)
+            batch.vertices[slot.quad * 4 + i] = batch.vertices[last * 4 + i];
+        batch.cells[slot.quad] = batch.cells[last];
+        batch.values[slot.quad] = batch.values[last];
+        chunk.slots[batch.cells[slot.quad]].quad = slot.quad;
+    }
+    batch.cells.pop_back();
+    batch.values.pop_back();
+    batch.vertices.resize(last * 4);
+}
+
+sf::Vertex* TileMap::getQuad(TileLayer& layer, unsigned x, unsigned y)
+{
+    TileChunk& chunk = getChunk(layer, x, y);
+    if (layer.sparse)
+    {
+        auto found = chunk.slots.find(mapSize.x * y + x);
+        if (found == chunk.slots.end())
+            return nullptr;
+        return &chunk.batches[found->second.batch].vertices[found->second.quad * 4];
+    }
+    unsigned tileset = getTileset(getFrame(layer.tiles.get(mapSize.x * y + x)));
+    return &getBatch(layer, x, y, tileset).vertices[getChunkIndex(x, y) * 4];
+}
+
+const sf::Vertex* TileMap::findQuad(const TileLayer& layer, unsigned x, unsigned y) const
+{
+    const TileChunk& chunk = layer.chunks[(x / chunkSize) + (y / chunkSize) * chunkCount.x];
+    if (layer.sparse)
+    {
+        auto found = chunk.slots.find(mapSize.x * y + x);
+        if (found == chunk.slots.end())
+            return nullptr;
+        return &chunk.batches[found->second.batch].vertices[found->second.quad * 4];
+    }
+    unsigned batchIndex = findBatch(chunk, getTileset(getFrame(layer.tiles.get(mapSize.x * y + x))));
+    if (batchIndex == chunk.batches.size())
+        return nullptr;
+    return &chunk.batches[batchIndex].vertices[getChunkIndex(x, y) * 4];
+}
+
+void TileMap::invalidateLod(TileLayer& layer, unsigned x, unsigned y, unsigned endX, unsigned endY)
+{
+    layer.overviewLevel = 0;
+    for (unsigned cy = y / chunkSize; cy <= (endY - 1) / chunkSize; ++cy)
+    {
+        for (unsigned cx = x / chunkSize; cx <= (endX - 1) / chunkSize; ++cx)
+            layer.chunks[cx + cy * chunkCount.x].lodBuilt = 0;
+    }
+}
+
+unsigned TileMap::chooseLodLevel(const sf::RenderTarget& target, const sf::FloatRect& viewRect) const
+{
+    float screenWidth = target.getSize().x * target.getView().getViewport().width;
+    if (lodThreshold <= 0 || viewRect.width <= 0 || screenWidth <= 0)
+        return 0;
+
+    // Merge blocks of tiles until they are at least as large as the threshold on the screen, or cover the whole map
+    float tilePixels = std::min(tileSize.x, tileSize.y) * screenWidth / viewRect.width;
+    unsigned level = 0;
+    while ((1u << level) < std::max(mapSize.x, mapSize.y) && tilePixels < lodThreshold)
+    {
+        tilePixels *= 2;
+        ++level;
+    }
+    return level;
+}
+
+void TileMap::buildLod(const TileLayer& layer, unsigned chunkIndex, unsigned level) const
+{
+    const TileChunk& chunk = layer.chunks[chunkIndex];
+    unsigned factor = 1u << level;
+    unsigned startX = (chunkIndex % chunkCount.x) * chunkSize;
+    unsigned startY = (chunkIndex / chunkCount.x) * chunkSize;
+    unsigned endX = std::min(startX + chunkSize, mapSize.x);
+    unsigned endY = std::min(startY + chunkSize, mapSize.y);
+    chunk.lods.resize(maxLodLevel);
+    std::vector<TileBatch>& batches = chunk.lods[level - 1];
+    batches.clear();
+
+    // Each block becomes one quad showing its most common tile, with the average color of its tiles
+    std::vector<std::pair<unsigned, unsigned>> counts; // Displayed ID -> tiles in the block
+    for (unsigned blockY = startY; blockY < endY; blockY += factor)
+    {
+        for (unsigned blockX = startX; blockX < endX; blockX += factor)
+        {
+            unsigned blockEndX = std::min(blockX + factor, endX);
+            unsigned blockEndY = std::min(blockY + factor, endY);
+            unsigned empty = 0;
+            unsigned color[4] = {0, 0, 0, 0};
+            counts.clear();
+            for (unsigned y = blockY; y < blockEndY; ++y)
+            {
+                for (unsigned x = blockX; x < blockEndX; ++x)
+                {
+                    const sf::Vertex* quad = findQuad(layer, x, y);
+                    if (!quad)
+                    {
+                        ++empty;
+                        continue;
+                    }
+                    unsigned display = getFrame(getTile(layer, x, y));
+                    auto found = std::find_if(counts.begin(), counts.end(),
+                        [display](const std::pair<unsigned, unsigned>& count){ return count.first == display; });
+                    if (found != counts.end())
+                        ++found->second;
+                    else
+                        counts.emplace_back(display, 1);
+                    color[0] += quad->color.r;
+                    color[1] += quad->color.g;
+                    color[2] += quad->color.b;
+                    color[3] += quad->color.a;
+                }
+            }
+
+            // Mostly empty blocks of sparse layers are left empty
+            unsigned tiles = (blockEndX - blockX) * (blockEndY - blockY) - empty;
+            if (counts.empty() || empty > tiles)
+                continue;
+            auto best = std::max_element(counts.begin(), counts.end(),
+                [](const std::pair<unsigned, unsigned>& a, const std::pair<unsigned, unsigned>& b){ return a.second < b.second; });
+
+            unsigned tileset = getTileset(best->first);
+            unsigned batchIndex = 0;
+            while (batchIndex < batches.size() && batches[batchIndex].tileset != tileset)
+                ++batchIndex;
+            if (batchIndex == batches.size())
+            {
+                batches.emplace_back();
+                batches.back().tileset = tileset;
+                batches.back().vertices.setPrimitiveType(sf::Quads);
+            }
+            sf::VertexArray& vertices = batches[batchIndex].vertices;
+            unsigned first = vertices.getVertexCount();
+            vertices.resize(first + 4);
+            sf::Vertex* quad = &vertices[first];
+            quad[0].position = sf::Vector2f(blockX * tileSize.x, blockY * tileSize.y);
+            quad[1].position = sf::Vector2f(blockEndX * tileSize.x, blockY * tileSize.y);
+            quad[2].position = sf::Vector2f(blockEndX * tileSize.x, blockEndY * tileSize.y);
+            quad[3].position = sf::Vector2f(blockX * tileSize.x, blockEndY * tileSize.y);
+            sf::Color average(color[0] / tiles, color[1] / tiles, color[2] / tiles, color[3] / tiles);
+            for (unsigned i = 0; i < 4; ++i)
+                quad[i].color = average;
+            setTexCoords(quad, best->first);
+        }
+    }
+    chunk.lodBuilt |= 1u << level;
+}
+
+unsigned TileMap::getOverviewLevel() const
+{
+    unsigned level = 0;
+    while (((mapSize.x - 1) >> level) >= maxOverviewBlocks || ((mapSize.y - 1) >> level) >= maxOverviewBlocks)
+        ++level;
+    return level;
+}
+
+void TileMap::buildOverview(const TileLayer& layer, unsigned level) const
+{
+    std::vector<TileBatch>& overview = layer.overview;
+    overview.clear();
+    auto getVertices = [&](unsigned tileset) -> sf::VertexArray&
+    {
+        for (auto& batch: overview)
+        {
+            if (batch.tileset == tileset)
+                return batch.vertices;
+        }
+        overview.emplace_back();
+        overview.back().tileset = tileset;
+        overview.back().vertices.setPrimitiveType(sf::Quads);
+        return overview.back().vertices;
+    };
+
+    // Make sure the merged quads of every chunk are up to date
+    unsigned chunkLevel = std::min(level, maxLodLevel);
+    for (unsigned chunkIndex = 0; chunkIndex < layer.chunks.size(); ++chunkIndex)
+    {
+        if (!(layer.chunks[chunkIndex].lodBuilt & (1u << chunkLevel)))
+            buildLod(layer, chunkIndex, chunkLevel);
+    }
+
+    // Up to the coarsest level of a chunk, the overview is just the merged quads of every chunk put together
+    if (level <= maxLodLevel)
+    {
+        for (auto& chunk: layer.chunks)
+        {
+            for (auto& batch: chunk.lods[level - 1])
+            {
+                sf::VertexArray& vertices = getVertices(batch.tileset);
+                unsigned first = vertices.getVertexCount();
+                vertices.resize(first + batch.vertices.getVertexCount());
+                for (unsigned i = 0; i < batch.vertices.getVertexCount(); ++i)
+                    vertices[first + i] = batch.vertices[i];
+            }
+        }
+        layer.overviewLevel = level;
+        return;
+    }
+
+    // Past that, each block of chunks becomes one quad showing the most common of their quads
+    struct ChunkQuad
+    {
+        unsigned tileset;
+        const sf::Vertex* quad;
+        unsigned count;
+    };
+    std::vector<ChunkQuad> counts;
+    unsigned factor = 1u << (level - maxLodLevel);
+    for (unsigned blockY = 0; blockY < chunkCount.y; blockY += factor)
+    {
+        for (unsigned blockX = 0; blockX < chunkCount.x; blockX += factor)
+        {
+            unsigned blockEndX = std::min(blockX + factor, chunkCount.x);
+            unsigned blockEndY = std::min(blockY + factor, chunkCount.y);
+            unsigned empty = 0;
+            unsigned color[4] = {0, 0, 0, 0};
+            counts.clear();
+            for (unsigned cy = blockY; cy < blockEndY; ++cy)
+            {
+                for (unsigned cx = blockX; cx < blockEndX; ++cx)
+                {
+                    // A chunk has at most one quad at the coarsest level
+                    const TileChunk& chunk = layer.chunks[cx + cy * chunkCount.x];
+                    auto batch = std::find_if(chunk.lods[maxLodLevel - 1].begin(), chunk.lods[maxLodLevel - 1].end(),
+                        [](const TileBatch& lod){ return lod.vertices.getVertexCount() > 0; });
+                    if (batch == chunk.lods[maxLodLevel - 1].end())
+                    {
+                        ++empty;
+                        continue;
+                    }
+                    const sf::Vertex* quad = &batch->vertices[0];
+                    auto found = std::find_if(counts.begin(), counts.end(), [&](const ChunkQuad& count)
+                        { return count.tileset == batch->tileset && count.quad->texCoords == quad->texCoords; });
+                    if (found != counts.end())
+                        ++found->count;
+                    else
+                        counts.push_back(ChunkQuad{batch->tileset, quad, 1});
+                    color[0] += quad->color.r;
+                    color[1] += quad->color.g;
+                    color[2] += quad->color.b;
+                    color[3] += quad->color.a;
+                }
+            }
+
+            // Mostly empty blocks are left empty, like in the merged quads of a chunk
+            unsigned chunks = (blockEndX - blockX) * (blockEndY - blockY) - empty;
+            if (counts.empty() || empty > chunks)
+                continue;
+            auto best = std::max_element(counts.begin(), counts.end(),
+                [](const ChunkQuad& a, const ChunkQuad& b){ return a.count < b.count; });
+            sf::VertexArray& vertices = getVertices(best->tileset);
+            unsigned first = vertices.getVertexCount();
+            vertices.resize(first + 4);
+            unsigned left = blockX * chunkSize * tileSize.x;
+            unsigned top = blockY * chunkSize * tileSize.y;
+            unsigned right = std::min(blockEndX * chunkSize, mapSize.x) * tileSize.x;
+            unsigned bottom = std::min(blockEndY * chunkSize, mapSize.y) * tileSize.y;
+            vertices[first].position = sf::Vector2f(left, top);
+            vertices[first + 1].position = sf::Vector2f(right, top);
+            vertices[first + 2].position = sf::Vector2f(right, bottom);
+            vertices[first + 3].position = sf::Vector2f(left, bottom);
+            sf::Color average(color[0] / chunks, color[1] / chunks, color[2] / chunks, color[3] / chunks);
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                vertices[first + i].color = average;
+                vertices[first + i].texCoords = best->quad[i].texCoords;
+            }
+        }
+    }
+    layer.overviewLevel = level;
+}
+
+void TileMap::updateMinimap(unsigned x, unsigned y, unsigned endX, unsigned endY)
+{
+    if (!minimapEnabled)
+        return;
+    if (minimapImage.getSize() != mapSize)
+    {
+        minimapImage.create(mapSize.x, mapSize.y, sf::Color::Transparent);
+        minimapDirty.assign(chunkCount.x * chunkCount.y, false);
+        x = 0;
+        y = 0;
+        endX = mapSize.x;
+        endY = mapSize.y;
+    }
+    if (x >= endX || y >= endY)
+        return;
+
+    // Each row only writes its own pixels, so large regions are recolored in parallel
+    ThreadPool::getDefault().parallelFor(endY - y, [&](unsigned begin, unsigned end)
+    {
+        for (unsigned row = y + begin; row < y + end; ++row)
+        {
+            for (unsigned column = x; column < endX; ++column)
+                minimapImage.setPixel(column, row, getMinimapColor(column, row));
+        }
+    }, minParallelRows);
+    for (unsigned cy = y / chunkSize; cy <= (endY - 1) / chunkSize; ++cy)
+    {
+        for (unsigned cx = x / chunkSize; cx <= (endX - 1) / chunkSize; ++cx)
+            minimapDirty[cx + cy * chunkCount.x] = true;
+    }
+}
+
+sf::Color TileMap::getMinimapColor(unsigned x, unsigned y) const
+{
+    // Look through the layers from the top, skipping empty and fully transparent tiles
+    for (auto index = drawOrder.rbegin(); index != drawOrder.rend(); ++index)
+    {
+        const TileLayer& layer = layers[*index];
+        if (layer.size != mapSize)
+            continue;
+        unsigned value = getTile(layer, x, y);
+        if (layer.sparse && !value)
+            continue;
+        const sf::Color& color = getAverageColor(value);
+        if (color.a)
+            return color;
+    }
+    return sf::Color::Transparent;
+}
+
+void TileMap::drawChunks(const TileLayer& layer, sf::RenderTarget& target, const sf::RenderStates& states) const
+{
+    if (layer.chunks.empty() || tileSize.x == 0 || tileSize.y == 0)
+        return;
+
+    // Find the visible area in the local coordinates of the tile map
+    sf::FloatRect viewRect = states.transform.getInverse().transformRect(views::getViewRect(target.getView()));
+
+    // Calculate the range of chunks that intersect the visible area
+    float chunkWidth = chunkSize * tileSize.x;
+    float chunkHeight = chunkSize * tileSize.y;
+    int startX = std::max(0, static_cast<int>(std::floor(viewRect.left / chunkWidth)));
+    int startY = std::max(0, static_cast<int>(std::floor(viewRect.top / chunkHeight)));
+    int endX = std::min(static_cast<int>(chunkCount.x), static_cast<int>(std::ceil((viewRect.left + viewRect.width) / chunkWidth)));
+    int endY = std::min(static_cast<int>(chunkCount.y), static_cast<int>(std::ceil((viewRect.top + viewRect.height) / chunkHeight)));
+
+    // Draw the whole layer from its overview when drawing the chunks one at a time would take too many draw calls,
+    // which always merges at least 2x2 tiles and never has more than the maximum number of blocks
+    lodLevel = chooseLodLevel(target, viewRect);
+    if (startX >= endX || startY >= endY)
+        return;
+    if (lodLevel > maxLodLevel || static_cast<unsigned>((endX - startX) * (endY - startY)) > maxLodChunks)
+    {
+        lodLevel = std::max(lodLevel, std::max(getOverviewLevel(), 1u));
+        if (layer.overviewLevel != lodLevel)
+            buildOverview(layer, lodLevel);
+        drawBatches(layer.overview, target, states);
+        return;
+    }
+
+    // Draw each batch of a chunk with the texture of its tileset, merging the tiles when they are small on the screen
+    for (int cy = startY; cy < endY; ++cy)
+    {
+        for (int cx = startX; cx < endX; ++cx)
+        {
+            unsigned chunkIndex = cx + cy * chunkCount.x;
+            const TileChunk& chunk = layer.chunks[chunkIndex];
+            if (lodLevel && !(chunk.lodBuilt & (1u << lodLevel)))
+                buildLod(layer, chunkIndex, lodLevel);
+            drawBatches(lodLevel ? chunk.lods[lodLevel - 1] : chunk.batches, target, states);
+        }
+    }
+}
+
+void TileMap::drawBatches(const std::vector<TileBatch>& batches, sf::RenderTarget& target, const sf::RenderStates& states) const
+{
+    sf::RenderStates batchStates(states);
+    for (auto& batch: batches)
+    {
+        if (batch.vertices.getVertexCount() > 0 && batch.tileset < tilesets.size())
+        {
+            batchStates.texture = &tilesets[batch.tileset].getTexture();
+            target.draw(batch.vertices, batchStates);
+            ++drawCalls;
+        }
     }
 }
 
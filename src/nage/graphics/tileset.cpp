@@ -0,0 +1,133 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/graphics/tileset.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace ng
+{
+
+Tileset::Tileset():
+    totalTypes(0),
+    padding(0)
+{
+}
+
+bool Tileset::loadFromFile(const std::string& filename, unsigned tileWidth, unsigned tileHeight, unsigned types, unsigned padding)
+{
+    this->filename = filename;
+    tileSize.x = tileWidth;
+    tileSize.y = tileHeight;
+    totalTypes = types;
+    this->padding = padding;
+    // The image is loaded first, so the average colors don't need to be read back from the texture
+    sf::Image image;
+    bool status = (image.loadFromFile(filename) && texture.loadFromImage(image));
+    buildTexCoords();
+    buildAverageColors(image);
+    return status;
+}
+
+void Tileset::setTexCoords(sf::Vertex* quad, unsigned value) const
+{
+    if (value * 4 < texCoords.size())
+    {
+        const sf::Vector2f* coords = &texCoords[value * 4];
+        quad[0].texCoords = coords[0];
+        quad[1].texCoords = coords[1];
+        quad[2].texCoords = coords[2];
+        quad[3].texCoords = coords[3];
+    }
+}
+
+const sf::Color& Tileset::getAverageColor(unsigned value) const
+{
+    return (value < averageColors.size() ? averageColors[value] : sf::Color::Transparent);
+}
+
+const sf::Texture& Tileset::getTexture() const
+{
+    return texture;
+}
+
+const std::string& Tileset::getFilename() const
+{
+    return filename;
+}
+
+const sf::Vector2u& Tileset::getTileSize() const
+{
+    return tileSize;
+}
+
+unsigned Tileset::getTotalTypes() const
+{
+    return totalTypes;
+}
+
+unsigned Tileset::getPadding() const
+{
+    return padding;
+}
+
+void Tileset::buildTexCoords()
+{
+    texCoords.clear();
+    if (tileSize.x == 0 || tileSize.y == 0)
+        return;
+
+    // Use all of the tiles in the texture if the total wasn't specified
+    unsigned tilesPerRow = texture.getSize().x / tileSize.x;
+    if (totalTypes == 0)
+        totalTypes = tilesPerRow * (texture.getSize().y / tileSize.y);
+
+    // Calculate the tile set position of every type once
+    texCoords.resize(totalTypes * 4);
+    for (unsigned value = 0; value < totalTypes && tilesPerRow > 0; ++value)
+    {
+        sf::Vector2u tilesetPos(value % tilesPerRow, value / tilesPerRow);
+        sf::Vector2f* coords = &texCoords[value * 4];
+        coords[0] = sf::Vector2f(tilesetPos.x * (tileSize.x + padding) + padding,
+                                 tilesetPos.y * (tileSize.y + padding) + padding);
+        coords[1] = sf::Vector2f((tilesetPos.x + 1) * (tileSize.x + padding),
+                                  tilesetPos.y * (tileSize.y + padding) + padding);
+        coords[2] = sf::Vector2f((tilesetPos.x + 1) * (tileSize.x + padding),
+                                 (tilesetPos.y + 1) * (tileSize.y + padding));
+        coords[3] = sf::Vector2f(tilesetPos.x * (tileSize.x + padding) + padding,
+                                (tilesetPos.y + 1) * (tileSize.y + padding));
+    }
+}
+
+void Tileset::buildAverageColors(const sf::Image& image)
+{
+    averageColors.assign(texCoords.size() / 4, sf::Color::Transparent);
+    const sf::Uint8* pixels = image.getPixelsPtr();
+    sf::Vector2u imageSize = image.getSize();
+    for (unsigned value = 0; value < averageColors.size() && pixels; ++value)
+    {
+        // The colors are weighted by alpha, so transparent pixels don't darken the tile
+        const sf::Vector2f& topLeft = texCoords[value * 4];
+        unsigned startX = topLeft.x;
+        unsigned startY = topLeft.y;
+        unsigned endX = std::min(startX + tileSize.x, imageSize.x);
+        unsigned endY = std::min(startY + tileSize.y, imageSize.y);
+        std::uint64_t red = 0, green = 0, blue = 0, alpha = 0;
+        for (unsigned y = startY; y < endY; ++y)
+        {
+            const sf::Uint8* pixel = pixels + (static_cast<std::size_t>(y) * imageSize.x + startX) * 4;
+            for (unsigned x = startX; x < endX; ++x, pixel += 4)
+            {
+                red += pixel[0] * pixel[3];
+                green += pixel[1] * pixel[3];
+                blue += pixel[2] * pixel[3];
+                alpha += pixel[3];
+            }
+        }
+        unsigned count = (endX > startX && endY > startY ? (endX - startX) * (endY - startY) : 0);
+        if (alpha)
+            averageColors[value] = sf::Color(red / alpha, green / alpha, blue / alpha, alpha / count);
+    }
+}
+
+}
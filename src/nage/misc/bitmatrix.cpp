@@ -0,0 +1,170 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/misc/bitmatrix.h"
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace ng
+{
+
+// Returns the index of the lowest set bit (the value must not be 0)
+static unsigned countTrailingZeros(std::uint64_t value)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#else
+    unsigned index = 0;
+    while (!(value & 1))
+    {
+        value >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+BitMatrix::BitMatrix()
+{
+    clear();
+}
+
+BitMatrix::BitMatrix(unsigned width, unsigned height)
+{
+    resize(width, height);
+}
+
+void BitMatrix::resize(unsigned width, unsigned height)
+{
+    matrixWidth = width;
+    matrixHeight = height;
+    rowWords = (width + 63) / 64;
+    words.assign(static_cast<std::size_t>(rowWords) * height, 0);
+}
+
+void BitMatrix::clear()
+{
+    matrixWidth = 0;
+    matrixHeight = 0;
+    rowWords = 0;
+    words.clear();
+    words.shrink_to_fit();
+}
+
+void BitMatrix::fill(bool value)
+{
+    if (!value)
+    {
+        std::fill(words.begin(), words.end(), 0);
+        return;
+    }
+
+    // Only set the bits inside of the matrix, so the padding of each row stays clear
+    for (unsigned y = 0; y < matrixHeight; ++y)
+    {
+        std::uint64_t* row = &words[static_cast<std::size_t>(y) * rowWords];
+        for (unsigned i = 0; i < rowWords; ++i)
+            row[i] = getMask(0, std::min(64u, matrixWidth - i * 64));
+    }
+}
+
+void BitMatrix::set(unsigned x, unsigned y, bool value)
+{
+    std::uint64_t& word = words[static_cast<std::size_t>(y) * rowWords + x / 64];
+    std::uint64_t bit = std::uint64_t(1) << (x % 64);
+    if (value)
+        word |= bit;
+    else
+        word &= ~bit;
+}
+
+bool BitMatrix::get(unsigned x, unsigned y) const
+{
+    return (words[static_cast<std::size_t>(y) * rowWords + x / 64] >> (x % 64)) & 1;
+}
+
+void BitMatrix::merge(const BitMatrix& other)
+{
+    if (other.matrixWidth == matrixWidth && other.matrixHeight == matrixHeight)
+    {
+        for (std::size_t i = 0; i < words.size(); ++i)
+            words[i] |= other.words[i];
+    }
+}
+
+void BitMatrix::toggle(const BitMatrix& other)
+{
+    if (other.matrixWidth == matrixWidth && other.matrixHeight == matrixHeight)
+    {
+        for (std::size_t i = 0; i < words.size(); ++i)
+            words[i] ^= other.words[i];
+    }
+}
+
+bool BitMatrix::any(unsigned x, unsigned y, unsigned endX, unsigned endY) const
+{
+    if (x >= endX)
+        return false;
+    unsigned firstWord = x / 64;
+    unsigned lastWord = (endX - 1) / 64;
+    std::uint64_t firstMask = getMask(x % 64, 64);
+    std::uint64_t lastMask = getMask(0, (endX - 1) % 64 + 1);
+    for (; y < endY; ++y)
+    {
+        const std::uint64_t* row = &words[static_cast<std::size_t>(y) * rowWords];
+        if (firstWord == lastWord)
+        {
+            if (row[firstWord] & firstMask & lastMask)
+                return true;
+            continue;
+        }
+        if ((row[firstWord] & firstMask) || (row[lastWord] & lastMask))
+            return true;
+        for (unsigned i = firstWord + 1; i < lastWord; ++i)
+        {
+            if (row[i])
+                return true;
+        }
+    }
+    return false;
+}
+
+unsigned BitMatrix::findInRow(unsigned y, unsigned x, unsigned endX) const
+{
+    if (x >= endX)
+        return endX;
+    const std::uint64_t* row = &words[static_cast<std::size_t>(y) * rowWords];
+    unsigned lastWord = (endX - 1) / 64;
+    std::uint64_t word = row[x / 64] & getMask(x % 64, 64);
+    for (unsigned i = x / 64; ; word = row[++i])
+    {
+        if (word)
+            return std::min(endX, i * 64 + countTrailingZeros(word));
+        if (i == lastWord)
+            return endX;
+    }
+}
+
+unsigned BitMatrix::width() const
+{
+    return matrixWidth;
+}
+
+unsigned BitMatrix::height() const
+{
+    return matrixHeight;
+}
+
+std::uint64_t BitMatrix::getMask(unsigned begin, unsigned end)
+{
+    std::uint64_t upper = (end >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << end) - 1);
+    return upper & ~((std::uint64_t(1) << begin) - 1);
+}
+
+}
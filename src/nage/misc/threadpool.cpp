@@ -0,0 +1,125 @@
+// Copyright (C) 2014-2015 Eric Hebert (ayebear)
+// This code is licensed under LGPLv3, see LICENSE.txt for details.
+
+#include "nage/misc/threadpool.h"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace ng
+{
+
+ThreadPool::ThreadPool(unsigned threadCount):
+    stopping(false)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+    // There is always at least one worker, so run() never blocks forever
+    threadCount = std::max(1u, threadCount);
+    for (unsigned i = 0; i < threadCount; ++i)
+        threads.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto& thread: threads)
+        thread.join();
+}
+
+unsigned ThreadPool::getThreadCount() const
+{
+    return threads.size();
+}
+
+void ThreadPool::parallelFor(unsigned count, const std::function<void(unsigned, unsigned)>& task, unsigned minSize)
+{
+    // Use a few pieces per thread, so uneven pieces still balance out
+    unsigned pieces = std::min<unsigned>((threads.size() + 1) * 4, count / std::max(1u, minSize));
+    if (pieces <= 1)
+    {
+        if (count > 0)
+            task(0, count);
+        return;
+    }
+
+    // Each thread takes the next piece until there are none left
+    struct State
+    {
+        std::atomic<unsigned> next;
+        unsigned done;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+    state->next = 0;
+    state->done = 0;
+    auto takePieces = [state, pieces, count, &task]
+    {
+        unsigned piece;
+        while ((piece = state->next++) < pieces)
+        {
+            task(static_cast<unsigned long long>(count) * piece / pieces,
+                static_cast<unsigned long long>(count) * (piece + 1) / pieces);
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (++state->done == pieces)
+                state->finished.notify_one();
+        }
+    };
+
+    // Helpers that start after all of the pieces are taken return right away,
+    // so the task reference is never used after this function returns
+    unsigned helpers = std::min<unsigned>(threads.size(), pieces - 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (unsigned i = 0; i < helpers; ++i)
+            tasks.emplace_back(takePieces);
+    }
+    condition.notify_all();
+    takePieces();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&]{ return state->done == pieces; });
+}
+
+std::future<void> ThreadPool::run(std::function<void()> task)
+{
+    auto packagedTask = std::make_shared<std::packaged_task<void()>>(std::move(task));
+    std::future<void> result = packagedTask->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.emplace_back([packagedTask]{ (*packagedTask)(); });
+    }
+    condition.notify_one();
+    return result;
+}
+
+ThreadPool& ThreadPool::getDefault()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]{ return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+}